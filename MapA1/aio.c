@@ -0,0 +1,477 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "map.h"
+#include "aio.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && !defined(MAP_AIO_BLOCKING)
+#include <sys/mman.h>
+#include <linux/io_uring.h>
+#define AIO_URING 1
+#endif
+#endif
+
+// a transfer never has more than one entry per buffer in flight
+#define AIO_RING_ENTRIES 4
+
+
+#ifdef AIO_URING
+// the queues shared with the kernel
+typedef struct map_aio_ring_s {
+	int fd;
+
+	// the mapped submission queue, completion queue and submission entries, the completion queue may be part of
+	// the submission queue mapping
+	unsigned char* submissions;
+	size_t submissionsSize;
+	unsigned char* completions;
+	size_t completionsSize;
+	struct io_uring_sqe* entries;
+	size_t entriesSize;
+
+	// the fields of the queues
+	unsigned int* sqTail;
+	unsigned int* sqMask;
+	unsigned int* sqArray;
+	unsigned int* cqHead;
+	unsigned int* cqTail;
+	unsigned int* cqMask;
+	struct io_uring_cqe* cqes;
+} aio_ring_t;
+
+//
+//	Releases the queues and closes the ring.
+//
+static void ring_close(aio_ring_t* ring) {
+	if (ring->entries != NULL) munmap(ring->entries, ring->entriesSize);
+	if (ring->completions != NULL && ring->completions != ring->submissions) munmap(ring->completions, ring->completionsSize);
+	if (ring->submissions != NULL) munmap(ring->submissions, ring->submissionsSize);
+	close(ring->fd);
+	free(ring);
+}
+
+//
+//	Creates a ring and maps its queues.
+//
+//	@return
+//		the ring or NULL if the kernel does not provide io_uring.
+//
+static aio_ring_t* ring_open() {
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	const int fd = (int)syscall(__NR_io_uring_setup, AIO_RING_ENTRIES, &params);
+	if (fd < 0) return NULL;
+
+	aio_ring_t* ring = calloc(1, sizeof(aio_ring_t));
+	if (ring == NULL) {
+		close(fd);
+		return NULL;
+	}
+	ring->fd = fd;
+	ring->submissionsSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	ring->completionsSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->entriesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	// newer kernels map both queues at once
+	const int single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single && ring->completionsSize > ring->submissionsSize) ring->submissionsSize = ring->completionsSize;
+
+	void* p = mmap(NULL, ring->submissionsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (p == MAP_FAILED) {
+		ring_close(ring);
+		return NULL;
+	}
+	ring->submissions = p;
+
+	if (single) {
+		ring->completions = ring->submissions;
+	} else {
+		p = mmap(NULL, ring->completionsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (p == MAP_FAILED) {
+			ring_close(ring);
+			return NULL;
+		}
+		ring->completions = p;
+	}
+
+	p = mmap(NULL, ring->entriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (p == MAP_FAILED) {
+		ring_close(ring);
+		return NULL;
+	}
+	ring->entries = p;
+
+	ring->sqTail = (unsigned int*)(ring->submissions + params.sq_off.tail);
+	ring->sqMask = (unsigned int*)(ring->submissions + params.sq_off.ring_mask);
+	ring->sqArray = (unsigned int*)(ring->submissions + params.sq_off.array);
+	ring->cqHead = (unsigned int*)(ring->completions + params.cq_off.head);
+	ring->cqTail = (unsigned int*)(ring->completions + params.cq_off.tail);
+	ring->cqMask = (unsigned int*)(ring->completions + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)(ring->completions + params.cq_off.cqes);
+	return ring;
+}
+
+//
+//	Queues a read or write of the provided buffer and hands it to the kernel.
+//
+//	@param ring
+//		the ring.
+//	@param fd
+//		the file.
+//	@param mode
+//		MAP_AIO_READ or MAP_AIO_WRITE.
+//	@param buffer
+//		the buffer to transfer.
+//	@param length
+//		the amount of bytes to transfer.
+//	@param offset
+//		the file offset.
+//	@param tag
+//		returned with the completion.
+//	@return
+//		OK or SYS_ERROR.
+//
+static int ring_submit(aio_ring_t* ring, const int fd, const int mode, void* buffer, const size_t length, const uint64_t offset, const uint64_t tag) {
+	// only this thread writes the tail
+	const unsigned int tail = *ring->sqTail;
+	const unsigned int index = tail & *ring->sqMask;
+	struct io_uring_sqe* entry = ring->entries + index;
+	memset(entry, 0, sizeof(struct io_uring_sqe));
+	entry->opcode = mode == MAP_AIO_WRITE ? IORING_OP_WRITE : IORING_OP_READ;
+	entry->fd = fd;
+	entry->addr = (uintptr_t)buffer;
+	entry->len = (uint32_t)length;
+	entry->off = offset;
+	entry->user_data = tag;
+	ring->sqArray[index] = index;
+	__atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+	long submitted;
+	do {
+		submitted = syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0);
+	} while (submitted < 0 && errno == EINTR);
+	return submitted == 1 ? OK : SYS_ERROR;
+}
+
+//
+//	Takes the next completion, waiting for it if there is none yet.
+//
+//	@param ring
+//		the ring.
+//	@param tag
+//		set to the tag of the completed transfer.
+//	@param result
+//		set to the amount of bytes transferred or the negative error number.
+//	@return
+//		OK or SYS_ERROR.
+//
+static int ring_reap(aio_ring_t* ring, uint64_t* tag, int* result) {
+	for (;;) {
+		const unsigned int head = *ring->cqHead;
+		if (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+			const struct io_uring_cqe* completion = ring->cqes + (head & *ring->cqMask);
+			*tag = completion->user_data;
+			*result = completion->res;
+			__atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+			return OK;
+		}
+		if (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+			return SYS_ERROR;
+		}
+	}
+}
+
+#ifdef AIO_TESTING
+int (*map_aio_reap)(struct map_aio_ring_s*, uint64_t*, int*) = ring_reap;
+#else
+#define map_aio_reap ring_reap
+#endif
+#endif
+
+//
+//	Transfers the rest of a buffer with blocking calls. A read stops at the end of the file.
+//
+//	@param aio
+//		the file.
+//	@param i
+//		the buffer.
+//	@return
+//		OK or SYS_ERROR.
+//
+static int aio_transfer(map_aio_t* aio, const int i) {
+	while (aio->done[i] < aio->length[i]) {
+		unsigned char* p = aio->buffers[i] + aio->done[i];
+		const size_t length = aio->length[i] - aio->done[i];
+		const off_t offset = (off_t)(aio->offset[i] + aio->done[i]);
+		const ssize_t n = aio->mode == MAP_AIO_WRITE ? pwrite(aio->fd, p, length, offset) : pread(aio->fd, p, length, offset);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) return SYS_ERROR;
+		if (n == 0) return aio->mode == MAP_AIO_WRITE ? SYS_ERROR : OK;
+		aio->done[i] += n;
+	}
+	return OK;
+}
+
+//
+//	Starts the transfer of a buffer. Without a ring the transfer is done before this returns.
+//
+//	@param aio
+//		the file.
+//	@param i
+//		the buffer.
+//	@param offset
+//		the file offset.
+//	@param length
+//		the amount of bytes.
+//
+static void aio_submit(map_aio_t* aio, const int i, const uint64_t offset, const size_t length) {
+	aio->offset[i] = offset;
+	aio->length[i] = length;
+	aio->done[i] = 0;
+	if (aio->result != OK) return;
+
+#ifdef AIO_URING
+	if (aio->ring != NULL) {
+		if (ring_submit(aio->ring, aio->fd, aio->mode, aio->buffers[i], length, offset, i) != OK) {
+			aio->result = SYS_ERROR;
+			return;
+		}
+		aio->pending[i] = 1;
+		return;
+	}
+#endif
+	if (aio_transfer(aio, i) != OK) aio->result = SYS_ERROR;
+}
+
+//
+//	Waits until the transfer of a buffer is complete.
+//
+//	@param aio
+//		the file.
+//	@param i
+//		the buffer.
+//	@return
+//		OK or SYS_ERROR, also if an earlier transfer failed.
+//
+static int aio_wait(map_aio_t* aio, const int i) {
+#ifdef AIO_URING
+	while (aio->pending[i]) {
+		uint64_t tag;
+		int n;
+		if (map_aio_reap(aio->ring, &tag, &n) != OK) {
+			// nothing can be completed anymore, the kernel may still use the buffers of the pending transfers, so
+			// map_aio_close does not release them
+			aio->lost = 1;
+			aio->pending[0] = aio->pending[1] = 0;
+			aio->result = SYS_ERROR;
+			return SYS_ERROR;
+		}
+
+		// kernels before 5.6 do not know the operation, then the blocking call does the transfer, as it does the
+		// rest of a short transfer
+		const int j = (int)tag;
+		aio->pending[j] = 0;
+		if (n < 0 && n != -EINVAL && n != -EOPNOTSUPP) {
+			aio->result = SYS_ERROR;
+			continue;
+		}
+		if (n > 0) aio->done[j] = n;
+		if ((n < 0 || aio->done[j] < aio->length[j]) && (n != 0 || aio->mode == MAP_AIO_WRITE)) {
+			if (aio_transfer(aio, j) != OK) aio->result = SYS_ERROR;
+		}
+	}
+#endif
+	(void)i;
+	return aio->result;
+}
+
+//
+//	Opens a file for sequential reading or writing. A file opened for writing is created or truncated.
+//
+//	@param aio
+//		the state to initialize.
+//	@param path
+//		the path of the file.
+//	@param mode
+//		MAP_AIO_READ or MAP_AIO_WRITE.
+//	@return
+//		OK, NULL_POINTER or SYS_ERROR.
+//
+int map_aio_open(map_aio_t* aio, const char* path, const int mode) {
+	if (aio == NULL || path == NULL) return NULL_POINTER;
+
+	memset(aio, 0, sizeof(map_aio_t));
+	aio->mode = mode;
+	const int flags = mode == MAP_AIO_WRITE ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY;
+	aio->fd = -1;
+#ifdef O_DIRECT
+	aio->fd = open(path, flags | O_DIRECT, 0644);
+	aio->direct = aio->fd >= 0;
+#endif
+	if (aio->fd < 0) aio->fd = open(path, flags, 0644);
+	if (aio->fd < 0) return SYS_ERROR;
+
+	struct stat info;
+	if (posix_memalign((void**)&aio->buffers[0], MAP_AIO_ALIGNMENT, MAP_AIO_BUFFER) != 0) aio->buffers[0] = NULL;
+	if (posix_memalign((void**)&aio->buffers[1], MAP_AIO_ALIGNMENT, MAP_AIO_BUFFER) != 0) aio->buffers[1] = NULL;
+	if (aio->buffers[0] == NULL || aio->buffers[1] == NULL || fstat(aio->fd, &info) != 0) {
+		free(aio->buffers[0]);
+		free(aio->buffers[1]);
+		close(aio->fd);
+		return SYS_ERROR;
+	}
+
+#ifdef AIO_URING
+	aio->ring = ring_open();
+#endif
+
+	// a reader starts to read both buffers at once
+	if (mode == MAP_AIO_READ) {
+		aio->size = info.st_size;
+		aio->next = 0;
+		int i;
+		for (i = 0; i < 2; i++) {
+			if (aio->next < aio->size) aio_submit(aio, i, aio->next, MAP_AIO_BUFFER);
+			aio->next += MAP_AIO_BUFFER;
+		}
+		aio_wait(aio, 0);
+	}
+	return OK;
+}
+
+//
+//	Appends bytes to a file opened for writing. A buffer is handed to the kernel when it is full, so the bytes may
+//	be written later, map_aio_close reports the errors of those writes.
+//
+//	@param aio
+//		the file.
+//	@param bytes
+//		the bytes.
+//	@param length
+//		the amount of bytes.
+//	@return
+//		OK, NULL_POINTER or SYS_ERROR.
+//
+int map_aio_write(map_aio_t* aio, const void* bytes, size_t length) {
+	if (aio == NULL || (bytes == NULL && length > 0)) return NULL_POINTER;
+	if (aio->mode != MAP_AIO_WRITE || aio->result != OK) return SYS_ERROR;
+
+	const unsigned char* p = bytes;
+	while (length > 0) {
+		const size_t piece = length < MAP_AIO_BUFFER - aio->position ? length : MAP_AIO_BUFFER - aio->position;
+		memcpy(aio->buffers[aio->current] + aio->position, p, piece);
+		aio->position += piece;
+		aio->size += piece;
+		p += piece;
+		length -= piece;
+
+		// write the full buffer and continue with the other one, once its previous write is done
+		if (aio->position == MAP_AIO_BUFFER) {
+			aio_submit(aio, aio->current, aio->next, MAP_AIO_BUFFER);
+			aio->next += MAP_AIO_BUFFER;
+			aio->current ^= 1;
+			aio->position = 0;
+			if (aio_wait(aio, aio->current) != OK) return SYS_ERROR;
+		}
+	}
+	return OK;
+}
+
+//
+//	Reads the next bytes of a file opened for reading. The next buffer is read while the current one is consumed.
+//
+//	@param aio
+//		the file.
+//	@param bytes
+//		the buffer for the bytes.
+//	@param length
+//		the amount of bytes.
+//	@return
+//		OK, NULL_POINTER, INVALID_FORMAT if the file ended before or SYS_ERROR.
+//
+int map_aio_read(map_aio_t* aio, void* bytes, size_t length) {
+	if (aio == NULL || (bytes == NULL && length > 0)) return NULL_POINTER;
+	if (aio->mode != MAP_AIO_READ || aio->result != OK) return SYS_ERROR;
+
+	unsigned char* p = bytes;
+	while (length > 0) {
+		const int i = aio->current;
+		if (aio->position == aio->done[i]) {
+			// a buffer that is not full was read up to the end of the file
+			if (aio->done[i] < MAP_AIO_BUFFER) return INVALID_FORMAT;
+
+			// read the next part into the consumed buffer and continue with the other one
+			if (aio->next < aio->size) {
+				aio_submit(aio, i, aio->next, MAP_AIO_BUFFER);
+			} else {
+				aio->length[i] = aio->done[i] = 0;
+			}
+			aio->next += MAP_AIO_BUFFER;
+			aio->current ^= 1;
+			aio->position = 0;
+			if (aio_wait(aio, aio->current) != OK) return SYS_ERROR;
+			continue;
+		}
+
+		const size_t available = aio->done[i] - aio->position;
+		const size_t piece = length < available ? length : available;
+		memcpy(p, aio->buffers[i] + aio->position, piece);
+		aio->position += piece;
+		p += piece;
+		length -= piece;
+	}
+	return OK;
+}
+
+//
+//	Closes a file. A file opened for writing is written completely, cut to the amount of bytes written and synced
+//	to the disk before it is closed. If the completion of a transfer could not be taken from the ring, the buffers
+//	are not released.
+//
+//	@param aio
+//		the file.
+//	@return
+//		OK, NULL_POINTER or SYS_ERROR if a write failed.
+//
+int map_aio_close(map_aio_t* aio) {
+	if (aio == NULL) return NULL_POINTER;
+
+	if (aio->mode == MAP_AIO_WRITE && aio->position > 0) {
+		// O_DIRECT only writes whole blocks, the padding is cut off below
+		size_t length = aio->position;
+		if (aio->direct) {
+			length = (length + MAP_AIO_ALIGNMENT - 1) & ~(size_t)(MAP_AIO_ALIGNMENT - 1);
+			memset(aio->buffers[aio->current] + aio->position, 0, length - aio->position);
+		}
+		aio_submit(aio, aio->current, aio->next, length);
+	}
+	aio_wait(aio, 0);
+	aio_wait(aio, 1);
+
+	int result = aio->result;
+	if (aio->mode == MAP_AIO_WRITE && result == OK) {
+		if (aio->direct && ftruncate(aio->fd, (off_t)aio->size) != 0) result = SYS_ERROR;
+		if (result == OK && fdatasync(aio->fd) != 0) result = SYS_ERROR;
+	}
+
+#ifdef AIO_URING
+	if (aio->ring != NULL) ring_close(aio->ring);
+	aio->ring = NULL;
+#endif
+
+	// the buffers of lost transfers are leaked, the kernel may write into them after the ring is closed
+	if (!aio->lost) {
+		free(aio->buffers[0]);
+		free(aio->buffers[1]);
+		aio->buffers[0] = aio->buffers[1] = NULL;
+	}
+	if (close(aio->fd) != 0 && aio->mode == MAP_AIO_WRITE) result = SYS_ERROR;
+	aio->fd = -1;
+	return result;
+}
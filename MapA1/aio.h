@@ -0,0 +1,70 @@
+#ifndef __A1_AIO_H__
+#define __A1_AIO_H__
+
+#include <stddef.h>
+#include <inttypes.h>
+
+//
+//	Sequential file I/O for snapshots without stdio. The file is written or read through two large aligned buffers:
+//	while one buffer is on its way to or from the disk, the other one is filled or consumed, so encoding the next
+//	blocks overlaps with writing the previous ones and decoding overlaps with reading ahead.
+//
+//	On Linux the transfers are queued to an io_uring and the file is opened with O_DIRECT, so the data bypasses the
+//	page cache. If the kernel refuses the ring (old kernels, seccomp) the transfers are blocking pwrite and pread
+//	calls and if the file system refuses O_DIRECT the page cache is used, the file is the same either way. Defining
+//	MAP_AIO_BLOCKING at compile time always uses the blocking calls.
+//
+
+// the size of each of the two buffers, a multiple of MAP_AIO_ALIGNMENT
+#define MAP_AIO_BUFFER (4 << 20)
+
+// the alignment of the buffers and of the transfers, required by O_DIRECT
+#define MAP_AIO_ALIGNMENT 4096
+
+// the modes of a file
+#define MAP_AIO_READ 0
+#define MAP_AIO_WRITE 1
+
+// the state of an open file
+typedef struct map_aio_s {
+	// the file descriptor, the mode and whether the file was opened with O_DIRECT
+	int fd;
+	int mode;
+	int direct;
+
+	// the io_uring or NULL if the transfers are blocking
+	struct map_aio_ring_s* ring;
+
+	// the two buffers, the file offset and amount of bytes of their transfer, the bytes actually transferred
+	// and whether the transfer is still running
+	unsigned char* buffers[2];
+	uint64_t offset[2];
+	size_t length[2];
+	size_t done[2];
+	int pending[2];
+
+	// the buffer being filled or consumed and the position in it
+	int current;
+	size_t position;
+
+	// the file offset of the next transfer and the size of the file
+	uint64_t next;
+	uint64_t size;
+
+	// the first error, once set every call fails
+	int result;
+
+	// set if transfers may still be running after their completion could not be taken from the ring
+	int lost;
+} map_aio_t;
+
+int map_aio_open(map_aio_t*, const char*, int);
+int map_aio_write(map_aio_t*, const void*, size_t);
+int map_aio_read(map_aio_t*, void*, size_t);
+int map_aio_close(map_aio_t*);
+
+// Test hook, only compiled in if AIO_TESTING is defined (see test/aio_test.c).
+#ifdef AIO_TESTING
+extern int (*map_aio_reap)(struct map_aio_ring_s*, uint64_t*, int*);
+#endif
+#endif
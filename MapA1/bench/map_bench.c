@@ -0,0 +1,318 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "map.h"
+#include "crc32c.h"
+#include "hash.h"
+
+//
+//	Microbenchmarks of the map operations. Every run builds a map of a given capacity and load factor from keys of a
+//	given length distribution and measures:
+//
+//	put		adding all keys to an empty map, including the rebuilds while it grows
+//	hit		map_get of all keys in random order
+//	miss	map_get of as many absent keys
+//	churn	removing a key and adding a new one, so the size stays the same and deleted slots pile up
+//	remove	removing all keys in random order
+//	fnv		fnv1_hash of all keys
+//	sip		SipHash-1-3 of all keys, including strlen, as map_hash does for seeded maps
+//	crc		the CRC32C hash of all keys, including strlen
+//
+//	The maps use FNV1 or, with -s or -c, SipHash with a random key or the CRC32C hash (see map_init_hash), so the
+//	cost of the hash shows up in the map operations as well.
+//	The capacities grow from a table that fits into the L1 cache up to ten times the last level cache (or a quarter
+//	of the memory, if that is less). The operations are timed in batches, the percentiles are those of the batches,
+//	so a single slow operation (a rebuild) shows up in the high percentiles of its batch.
+//
+//	usage: map_bench [-q] [-s | -c] [-m max bytes] [-o min operations]
+//		-q	quick, stop at the size of the last level cache
+//		-s	the maps hash with SipHash
+//		-c	the maps hash with CRC32C
+//		-m	the maximal memory of one run
+//		-o	small maps are repeated until every operation ran at least this often, default 1M
+//
+
+// the amount of operations timed together
+#define BENCH_BATCH 16
+
+// the smallest capacity
+#define BENCH_MIN_CAPACITY (1 << 10)
+
+// the key length distributions
+typedef struct {
+	const char* name;
+	unsigned int min;
+	unsigned int max;
+} bench_keys_t;
+
+static const bench_keys_t bench_distributions[] = {
+	{ "short", 8, 8 },
+	{ "medium", 24, 24 },
+	{ "long", 64, 64 },
+	{ "mixed", 8, 128 },
+};
+
+static const double bench_loads[] = { 0.55, 0.75, 0.9 };
+
+// the timings of one operation, in nanoseconds per operation of every batch
+typedef struct {
+	double* samples;
+	size_t count;
+	size_t length;
+	double total;
+	uint64_t operations;
+} bench_timing_t;
+
+// prevents the compiler from removing the calls
+static volatile uintptr_t bench_sink;
+
+// the hash function of the maps and the key of the sip and crc rows
+static int bench_hashKind = MAP_HASH_FNV1;
+static const uint64_t bench_seed[2] = { 0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL };
+
+// the state of the random generator
+static uint64_t bench_state = 0x9E3779B97F4A7C15ULL;
+
+
+static uint64_t bench_random() {
+	bench_state ^= bench_state << 13;
+	bench_state ^= bench_state >> 7;
+	bench_state ^= bench_state << 17;
+	return bench_state;
+}
+
+static uint64_t bench_now() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+//
+//	Creates the keys: a unique number in base 36, a separator that keeps the sets apart and random letters up to
+//	the length drawn from the distribution.
+//
+//	@param keys
+//		the array to fill.
+//	@param count
+//		the amount of keys.
+//	@param distribution
+//		the key lengths.
+//	@param separator
+//		'-' for the keys in the map, '+' for the absent keys.
+//	@return
+//		the memory holding the keys, to be released by the caller, or NULL.
+//
+static char* bench_keys(char** keys, const size_t count, const bench_keys_t* distribution, const char separator) {
+	char* memory = malloc((size_t)count * (distribution->max + 16));
+	if (memory == NULL) return NULL;
+
+	char* p = memory;
+	size_t i;
+	for (i = 0; i < count; i++) {
+		keys[i] = p;
+		size_t n = i;
+		do {
+			*p++ = "0123456789abcdefghijklmnopqrstuvwxyz"[n % 36];
+			n /= 36;
+		} while (n > 0);
+		*p++ = separator;
+
+		const unsigned int length = distribution->min + (unsigned int)(bench_random() % (distribution->max - distribution->min + 1));
+		while ((unsigned int)(p - keys[i]) < length) *p++ = 'a' + (char)(bench_random() % 26);
+		*p++ = 0;
+	}
+	return memory;
+}
+
+static void bench_shuffle(char** keys, const size_t count) {
+	size_t i;
+	for (i = count; i > 1; i--) {
+		const size_t j = bench_random() % i;
+		char* key = keys[i - 1];
+		keys[i - 1] = keys[j];
+		keys[j] = key;
+	}
+}
+
+static int bench_record(bench_timing_t* timing, const uint64_t nanos, const unsigned int operations) {
+	if (timing->count == timing->length) {
+		const size_t length = timing->length == 0 ? 1024 : timing->length * 2;
+		double* samples = realloc(timing->samples, sizeof(double) * length);
+		if (samples == NULL) return -1;
+		timing->samples = samples;
+		timing->length = length;
+	}
+	timing->samples[timing->count++] = (double)nanos / operations;
+	timing->total += nanos;
+	timing->operations += operations;
+	return 0;
+}
+
+static int bench_compare(const void* a, const void* b) {
+	const double x = *(const double*)a;
+	const double y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+static double bench_percentile(const bench_timing_t* timing, const double p) {
+	size_t i = (size_t)(p * timing->count);
+	return timing->samples[i < timing->count ? i : timing->count - 1];
+}
+
+//
+//	Runs one operation on all keys, timed in batches.
+//
+//	@param timing
+//		receives the timings.
+//	@param operation
+//		0 put, 1 get, 2 remove, 3 churn, 4 fnv, 5 sip, 6 crc.
+//	@param map
+//		the map.
+//	@param keys
+//		the keys of the operation.
+//	@param others
+//		for the churn, the keys added while keys are removed.
+//	@param count
+//		the amount of keys.
+//
+static void bench_operation(bench_timing_t* timing, const int operation, map_t* map, char** keys, char** others, const size_t count) {
+	uintptr_t sink = 0;
+	size_t i = 0;
+	while (i < count) {
+		const size_t end = count - i < BENCH_BATCH ? count : i + BENCH_BATCH;
+		const unsigned int operations = (unsigned int)(end - i);
+		const uint64_t start = bench_now();
+		switch (operation) {
+		case 0: for (; i < end; i++) sink += map_put(map, keys[i], keys[i]); break;
+		case 1: for (; i < end; i++) sink += (uintptr_t)map_get(map, keys[i]); break;
+		case 2: for (; i < end; i++) sink += map_remove(map, keys[i]); break;
+		case 3: for (; i < end; i++) sink += map_remove(map, keys[i]) + map_put(map, others[i], others[i]); break;
+		case 4: for (; i < end; i++) sink += (uintptr_t)fnv1_hash(keys[i]); break;
+		case 5: for (; i < end; i++) sink += (uintptr_t)map_siphash(bench_seed, keys[i], strlen(keys[i])); break;
+		default: for (; i < end; i++) sink += (uintptr_t)map_crc32c_hash(bench_seed, keys[i], strlen(keys[i])); break;
+		}
+		bench_record(timing, bench_now() - start, operations);
+	}
+	bench_sink += sink;
+}
+
+static void bench_report(const char* name, const bench_keys_t* distribution, const size_t capacity, const double load, bench_timing_t* timing) {
+	if (timing->count == 0) return;
+	qsort(timing->samples, timing->count, sizeof(double), bench_compare);
+	printf("%-7s %-7s %10zu %5.2f %9.1f %9.1f %9.1f %9.1f %9.1f\n", name, distribution->name, capacity, load,
+		timing->total / timing->operations, bench_percentile(timing, 0.5), bench_percentile(timing, 0.9),
+		bench_percentile(timing, 0.99), bench_percentile(timing, 0.999));
+	timing->count = 0;
+	timing->total = 0;
+	timing->operations = 0;
+}
+
+//
+//	Runs all operations for one capacity, load factor and key length distribution.
+//
+static int bench_run(const bench_keys_t* distribution, const size_t capacity, const double load, const uint64_t minOperations) {
+	// the map grows to the capacity once it is half full, so the amount of keys selects the load factor
+	const size_t count = (size_t)(capacity * load);
+	char** keys = malloc(sizeof(char*) * count);
+	char** absent = malloc(sizeof(char*) * count);
+	char* keyMemory = keys != NULL ? bench_keys(keys, count, distribution, '-') : NULL;
+	char* absentMemory = absent != NULL ? bench_keys(absent, count, distribution, '+') : NULL;
+	if (keyMemory == NULL || absentMemory == NULL) {
+		fprintf(stderr, "out of memory at capacity %zu\n", capacity);
+		free(keyMemory);
+		free(absentMemory);
+		free(keys);
+		free(absent);
+		return -1;
+	}
+
+	static const char* names[] = { "put", "hit", "miss", "churn", "remove", "fnv", "sip", "crc" };
+	bench_timing_t timings[8];
+	memset(timings, 0, sizeof(timings));
+	double actualLoad = 0;
+
+	uint64_t repeats = (minOperations + count - 1) / count;
+	while (repeats-- > 0) {
+		map_t map;
+		map_init_hash(&map, bench_hashKind, NULL);
+		bench_shuffle(keys, count);
+		bench_operation(timings + 0, 0, &map, keys, NULL, count);
+
+		map_stats_t stats;
+		map_stats(&map, &stats);
+		actualLoad = stats.loadFactor;
+
+		bench_shuffle(keys, count);
+		bench_operation(timings + 1, 1, &map, keys, NULL, count);
+		bench_operation(timings + 2, 1, &map, absent, NULL, count);
+		bench_operation(timings + 3, 3, &map, keys, absent, count);
+		bench_shuffle(absent, count);
+		bench_operation(timings + 4, 2, &map, absent, NULL, count);
+		bench_operation(timings + 5, 4, NULL, keys, NULL, count);
+		bench_operation(timings + 6, 5, NULL, keys, NULL, count);
+		bench_operation(timings + 7, 6, NULL, keys, NULL, count);
+		map_destroy(&map);
+	}
+
+	int i;
+	for (i = 0; i < 8; i++) {
+		bench_report(names[i], distribution, capacity, actualLoad, timings + i);
+		free(timings[i].samples);
+	}
+	fflush(stdout);
+
+	free(keyMemory);
+	free(absentMemory);
+	free(keys);
+	free(absent);
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	int quick = 0;
+	size_t maxBytes = 0;
+	uint64_t minOperations = 1 << 20;
+	int option;
+	while ((option = getopt(argc, argv, "qscm:o:")) != -1) {
+		switch (option) {
+		case 'q': quick = 1; break;
+		case 's': bench_hashKind = MAP_HASH_SIPHASH; break;
+		case 'c': bench_hashKind = MAP_HASH_CRC32C; break;
+		case 'm': maxBytes = strtoull(optarg, NULL, 0); break;
+		case 'o': minOperations = strtoull(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "usage: %s [-q] [-s | -c] [-m max bytes] [-o min operations]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	// ten times the last level cache, but not more than a quarter of the memory
+	long cache = sysconf(_SC_LEVEL3_CACHE_SIZE);
+	if (cache <= 0) cache = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	if (cache <= 0) cache = 8 << 20;
+	if (maxBytes == 0) {
+		const size_t memory = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE);
+		maxBytes = quick ? (size_t)cache : (size_t)cache * 10;
+		if (memory > 0 && maxBytes > memory / 4) maxBytes = memory / 4;
+	}
+
+	printf("%-7s %-7s %10s %5s %9s %9s %9s %9s %9s\n", "op", "keys", "capacity", "load", "ns/op", "p50", "p90", "p99", "p99.9");
+	size_t d;
+	for (d = 0; d < sizeof(bench_distributions) / sizeof(bench_distributions[0]); d++) {
+		const bench_keys_t* distribution = bench_distributions + d;
+		size_t l;
+		for (l = 0; l < sizeof(bench_loads) / sizeof(bench_loads[0]); l++) {
+			size_t capacity;
+			for (capacity = BENCH_MIN_CAPACITY;; capacity *= 4) {
+				// the slots, both key sets and their pointers
+				const size_t perKey = sizeof(map_entry_t) / bench_loads[l] + 2 * (distribution->max + 16 + sizeof(char*));
+				if (capacity * bench_loads[l] * perKey > maxBytes) break;
+				if (bench_run(distribution, capacity, bench_loads[l], minOperations) != 0) return 1;
+			}
+		}
+	}
+	return (int)(bench_sink & 0);
+}
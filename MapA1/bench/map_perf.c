@@ -0,0 +1,616 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "map.h"
+#include "snapshot.h"
+
+//
+//	Performance regression suite. Replays realistic workloads against the map and reports the time and the hardware
+//	counters per operation. The workloads are generated from a fixed seed, so every run replays exactly the same
+//	operations on the same keys:
+//
+//	bulk-put	adding all keys to an empty map
+//	bulk-load	loading a snapshot of all keys into an empty map, per key
+//	zipf		reads of keys drawn from a zipfian distribution (s = 0.99), one in ten absent, and one in twenty
+//				operations replaces a key by removing and adding it
+//	sessions	a sliding window of sessions: every step adds a session, reads three live ones and removes the oldest
+//
+//	The counters are read with perf_event_open (cycles, instructions, cache misses, L1 data read misses), they are
+//	reported as n/a if the kernel does not allow that. Every workload runs several times and the median is reported.
+//
+//	usage: map_perf [-n keys] [-r runs] [-s seed] [-w baseline] [-c baseline] [-t tolerance] [-f operations]
+//		-n	the amount of keys, default 1M
+//		-r	the amount of runs of every workload, default 3
+//		-w	writes the results to the baseline file
+//		-c	compares the results with the baseline file, every metric may be worse by the tolerance in percent
+//			(default 10), otherwise the run fails
+//		-f	instead of measuring, applies random operations and checks the map against a simple model
+//
+
+// the amount of operations timed together for the percentiles
+#define PERF_BATCH 16
+
+// the metrics of a workload
+#define PERF_NANOS 0
+#define PERF_P99 1
+#define PERF_CYCLES 2
+#define PERF_INSTRUCTIONS 3
+#define PERF_CACHE_MISSES 4
+#define PERF_L1_MISSES 5
+#define PERF_METRICS 6
+
+static const char* perf_metric_names[PERF_METRICS] = {
+	"ns/op", "p99", "cycles/op", "instructions/op", "cache-misses/op", "l1d-misses/op"
+};
+
+// the amount of hardware counters, they are the metrics from PERF_CYCLES on
+#define PERF_COUNTERS 4
+
+// the results of a workload, negative if not available
+typedef struct {
+	const char* name;
+	double metrics[PERF_METRICS];
+} perf_result_t;
+
+// the state of a workload run
+typedef struct {
+	// the file descriptors of the hardware counters, -1 if not available
+	int counters[PERF_COUNTERS];
+
+	// the batch timings of the run and the start of the current batch
+	double* samples;
+	size_t count;
+	size_t length;
+	uint64_t batchStart;
+	unsigned int batchOperations;
+
+	// the amount of operations and the start of the run
+	uint64_t operations;
+	uint64_t started;
+} perf_run_t;
+
+// the keys of the workloads
+typedef struct {
+	char** keys;
+	char* memory;
+	size_t count;
+} perf_keys_t;
+
+// prevents the compiler from removing the calls
+static volatile uintptr_t perf_sink;
+
+// the state of the random generator
+static uint64_t perf_state;
+
+
+static uint64_t perf_random() {
+	perf_state ^= perf_state << 13;
+	perf_state ^= perf_state >> 7;
+	perf_state ^= perf_state << 17;
+	return perf_state;
+}
+
+static uint64_t perf_now() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+//
+//	Opens a hardware counter of this thread, counting only user space.
+//
+//	@return
+//		the file descriptor or -1 if the counter is not available.
+//
+static int perf_open(const uint32_t type, const uint64_t config) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void perf_counters_open(perf_run_t* run) {
+	run->counters[0] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	run->counters[1] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	run->counters[2] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+	run->counters[3] = perf_open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+		| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+}
+
+static void perf_counters_close(perf_run_t* run) {
+	int c;
+	for (c = 0; c < PERF_COUNTERS; c++) {
+		if (run->counters[c] >= 0) close(run->counters[c]);
+	}
+}
+
+//
+//	Starts to measure a run, everything between perf_start and perf_stop is counted.
+//
+static void perf_start(perf_run_t* run) {
+	run->count = 0;
+	run->operations = 0;
+	run->batchOperations = 0;
+	int c;
+	for (c = 0; c < PERF_COUNTERS; c++) {
+		if (run->counters[c] < 0) continue;
+		ioctl(run->counters[c], PERF_EVENT_IOC_RESET, 0);
+		ioctl(run->counters[c], PERF_EVENT_IOC_ENABLE, 0);
+	}
+	run->started = perf_now();
+	run->batchStart = run->started;
+}
+
+//
+//	Counts operations, every PERF_BATCH operations the time of the batch is recorded.
+//
+static inline void perf_tick(perf_run_t* run, const unsigned int operations) {
+	run->batchOperations += operations;
+	if (run->batchOperations < PERF_BATCH) return;
+
+	const uint64_t now = perf_now();
+	if (run->count == run->length) {
+		const size_t length = run->length == 0 ? 4096 : run->length * 2;
+		double* samples = realloc(run->samples, sizeof(double) * length);
+		if (samples == NULL) return;
+		run->samples = samples;
+		run->length = length;
+	}
+	run->samples[run->count++] = (double)(now - run->batchStart) / run->batchOperations;
+	run->operations += run->batchOperations;
+	run->batchOperations = 0;
+	run->batchStart = now;
+}
+
+static int perf_compare(const void* a, const void* b) {
+	const double x = *(const double*)a;
+	const double y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+//
+//	Stops to measure a run and fills the metrics.
+//
+//	@param run
+//		the run.
+//	@param operations
+//		the amount of operations the metrics are divided by, 0 for the operations counted by perf_tick.
+//	@param metrics
+//		the metrics to fill.
+//
+static void perf_stop(perf_run_t* run, uint64_t operations, double* metrics) {
+	const uint64_t nanos = perf_now() - run->started;
+	uint64_t values[PERF_COUNTERS];
+	int c;
+	for (c = 0; c < PERF_COUNTERS; c++) {
+		if (run->counters[c] < 0) continue;
+		ioctl(run->counters[c], PERF_EVENT_IOC_DISABLE, 0);
+		if (read(run->counters[c], values + c, sizeof(uint64_t)) != sizeof(uint64_t)) values[c] = 0;
+	}
+
+	if (operations == 0) operations = run->operations + run->batchOperations;
+	if (operations == 0) operations = 1;
+	metrics[PERF_NANOS] = (double)nanos / operations;
+	metrics[PERF_P99] = -1;
+	if (run->count > 0) {
+		qsort(run->samples, run->count, sizeof(double), perf_compare);
+		metrics[PERF_P99] = run->samples[(size_t)(0.99 * (run->count - 1))];
+	}
+	for (c = 0; c < PERF_COUNTERS; c++) {
+		metrics[PERF_CYCLES + c] = run->counters[c] >= 0 ? (double)values[c] / operations : -1;
+	}
+}
+
+//
+//	Creates unique keys of 12 to 40 characters: a number in base 36, a separator and random letters.
+//
+static int perf_keys(perf_keys_t* keys, const size_t count, const char separator) {
+	keys->count = count;
+	keys->keys = malloc(sizeof(char*) * count);
+	keys->memory = malloc(count * 48);
+	if (keys->keys == NULL || keys->memory == NULL) return -1;
+
+	char* p = keys->memory;
+	size_t i;
+	for (i = 0; i < count; i++) {
+		keys->keys[i] = p;
+		size_t n = i;
+		do {
+			*p++ = "0123456789abcdefghijklmnopqrstuvwxyz"[n % 36];
+			n /= 36;
+		} while (n > 0);
+		*p++ = separator;
+		const unsigned int length = 12 + (unsigned int)(perf_random() % 29);
+		while ((unsigned int)(p - keys->keys[i]) < length) *p++ = 'a' + (char)(perf_random() % 26);
+		*p++ = 0;
+	}
+	return 0;
+}
+
+static void perf_keys_free(perf_keys_t* keys) {
+	free(keys->keys);
+	free(keys->memory);
+}
+
+static void perf_shuffle(char** keys, const size_t count) {
+	size_t i;
+	for (i = count; i > 1; i--) {
+		const size_t j = perf_random() % i;
+		char* key = keys[i - 1];
+		keys[i - 1] = keys[j];
+		keys[j] = key;
+	}
+}
+
+//
+//	Runs a workload several times and keeps the run with the median time.
+//
+static void perf_median(perf_result_t* result, double (*runs)[PERF_METRICS], const unsigned int count) {
+	unsigned int order[64];
+	unsigned int i, j;
+	for (i = 0; i < count; i++) order[i] = i;
+	for (i = 1; i < count; i++) {
+		for (j = i; j > 0 && runs[order[j]][PERF_NANOS] < runs[order[j - 1]][PERF_NANOS]; j--) {
+			const unsigned int t = order[j];
+			order[j] = order[j - 1];
+			order[j - 1] = t;
+		}
+	}
+	memcpy(result->metrics, runs[order[count / 2]], sizeof(result->metrics));
+}
+
+static void perf_bulk(perf_run_t* run, perf_keys_t* keys, double* put, double* load) {
+	map_t map;
+	map_init(&map);
+	perf_shuffle(keys->keys, keys->count);
+
+	perf_start(run);
+	size_t i;
+	for (i = 0; i < keys->count; i++) {
+		perf_sink += map_put(&map, keys->keys[i], keys->keys[i]);
+		perf_tick(run, 1);
+	}
+	perf_stop(run, 0, put);
+
+	// the snapshot is written to memory, so only the loading is measured
+	char* buffer = NULL;
+	size_t length = 0;
+	FILE* stream = open_memstream(&buffer, &length);
+	if (stream == NULL || map_serialize(&map, stream) != OK || fclose(stream) != 0) {
+		load[PERF_NANOS] = -1;
+	} else {
+		map_t loaded;
+		map_init(&loaded);
+		stream = fmemopen(buffer, length, "rb");
+		perf_start(run);
+		if (stream == NULL || map_deserialize(&loaded, stream) != OK) fprintf(stderr, "bulk-load failed\n");
+		perf_stop(run, keys->count, load);
+		if (stream != NULL) fclose(stream);
+		map_destroy(&loaded);
+	}
+	free(buffer);
+	map_destroy(&map);
+}
+
+static void perf_zipf(perf_run_t* run, perf_keys_t* keys, const double* cdf, double* metrics) {
+	// one in ten ranks selects an absent key
+	map_t map;
+	map_init(&map);
+	size_t i;
+	for (i = 0; i < keys->count; i++) {
+		if (i % 10 != 9) map_put(&map, keys->keys[i], keys->keys[i]);
+	}
+
+	const size_t operations = 4 * keys->count;
+	perf_start(run);
+	for (i = 0; i < operations; i++) {
+		// the rank is found by a binary search in the cumulative distribution
+		const double u = (double)(perf_random() >> 11) / (double)(1ULL << 53);
+		size_t low = 0;
+		size_t high = keys->count - 1;
+		while (low < high) {
+			const size_t middle = (low + high) / 2;
+			if (cdf[middle] < u) low = middle + 1;
+			else high = middle;
+		}
+		const char* key = keys->keys[low];
+
+		if (i % 20 == 0 && low % 10 != 9) {
+			perf_sink += map_remove(&map, key) + map_put(&map, key, key);
+			perf_tick(run, 2);
+		} else {
+			perf_sink += (uintptr_t)map_get(&map, key);
+			perf_tick(run, 1);
+		}
+	}
+	perf_stop(run, 0, metrics);
+	map_destroy(&map);
+}
+
+static void perf_sessions(perf_run_t* run, perf_keys_t* keys, double* metrics) {
+	// the window holds a quarter of the keys, every key is a session once
+	const size_t window = keys->count / 4;
+	map_t map;
+	map_init(&map);
+	size_t i;
+	for (i = 0; i < window; i++) map_put(&map, keys->keys[i], keys->keys[i]);
+
+	perf_start(run);
+	for (i = window; i < keys->count; i++) {
+		perf_sink += map_put(&map, keys->keys[i], keys->keys[i]);
+		int r;
+		for (r = 0; r < 3; r++) {
+			// recent sessions are read more often
+			const size_t age = (perf_random() % window) * (perf_random() % window) / window;
+			perf_sink += (uintptr_t)map_get(&map, keys->keys[i - age]);
+		}
+		perf_sink += map_remove(&map, keys->keys[i - window]);
+		perf_tick(run, 5);
+	}
+	perf_stop(run, 0, metrics);
+	map_destroy(&map);
+}
+
+//
+//	Reads a baseline file and compares the results with it.
+//
+//	@return
+//		the amount of metrics that are worse than the baseline plus the tolerance.
+//
+static int perf_compare_baseline(const char* path, const perf_result_t* results, const unsigned int count, const double tolerance) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "cannot read the baseline %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	int regressions = 0;
+	char workload[64];
+	char metric[64];
+	double expected;
+	while (fscanf(file, "%63s %63s %lf", workload, metric, &expected) == 3) {
+		unsigned int w;
+		int m;
+		for (w = 0; w < count; w++) {
+			if (strcmp(results[w].name, workload) != 0) continue;
+			for (m = 0; m < PERF_METRICS; m++) {
+				if (strcmp(perf_metric_names[m], metric) != 0) continue;
+				const double actual = results[w].metrics[m];
+				if (actual < 0 || expected <= 0) continue;
+				if (actual > expected * (1 + tolerance / 100)) {
+					printf("REGRESSION %s %s: %.2f, baseline %.2f (+%.1f%%)\n", workload, metric, actual, expected,
+						(actual / expected - 1) * 100);
+					regressions++;
+				}
+			}
+		}
+	}
+	fclose(file);
+	return regressions;
+}
+
+static int perf_write_baseline(const char* path, const perf_result_t* results, const unsigned int count) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "cannot write the baseline %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	unsigned int w;
+	int m;
+	for (w = 0; w < count; w++) {
+		for (m = 0; m < PERF_METRICS; m++) {
+			if (results[w].metrics[m] >= 0) fprintf(file, "%s %s %.3f\n", results[w].name, perf_metric_names[m], results[w].metrics[m]);
+		}
+	}
+	return fclose(file) == 0 ? 0 : 1;
+}
+
+//
+//	Applies random operations to a map and checks every result against a model, which is an array of the values
+//	of a small set of keys. The map is checked completely from time to time, also after a snapshot round trip. The
+//	map hashes with SipHash and has a filter (see map_filter), the snapshots are loaded in turn by a map with the same
+//	key and by maps with FNV1 and CRC32C, which have to hash the keys again, every other one with a filter.
+//
+//	@return
+//		the amount of failed checks.
+//
+static int perf_fuzz(const uint64_t operations) {
+	enum { KEYS = 1000, VALUES = 8 };
+	static char keys[KEYS][24];
+	static char values[VALUES][16];
+	static const char* model[KEYS];
+	static int present[KEYS];
+	int failures = 0;
+
+	unsigned int k;
+	for (k = 0; k < KEYS; k++) {
+		// some keys share their start, so the comparisons of colliding keys are exercised
+		sprintf(keys[k], k % 3 ? "key-%u" : "key-%u-%u", k, k * 7919);
+	}
+	for (k = 0; k < VALUES; k++) sprintf(values[k], "value-%u", k);
+
+	map_t map;
+	map_init_hash(&map, MAP_HASH_SIPHASH, NULL);
+	map_filter(&map, 1);
+	uint64_t i;
+	for (i = 1; i <= operations && failures < 10; i++) {
+		const unsigned int key = (unsigned int)(perf_random() % KEYS);
+		const unsigned int operation = (unsigned int)(perf_random() % 100);
+		if (operation < 45) {
+			const char* value = perf_random() % 8 == 0 ? NULL : values[perf_random() % VALUES];
+			const int result = map_put(&map, keys[key], value);
+			if (result != (present[key] ? KEY_EXISTS : OK)) {
+				fprintf(stderr, "fuzz %" PRIu64 ": map_put(%s) returned %d\n", i, keys[key], result);
+				failures++;
+			}
+			if (!present[key]) model[key] = value;
+			present[key] = 1;
+		} else if (operation < 75) {
+			const int result = map_remove(&map, keys[key]);
+			if (result != (present[key] ? OK : NO_KEY_EXISTS)) {
+				fprintf(stderr, "fuzz %" PRIu64 ": map_remove(%s) returned %d\n", i, keys[key], result);
+				failures++;
+			}
+			present[key] = 0;
+		} else {
+			const char* value = map_get(&map, keys[key]);
+			if (value != (present[key] ? model[key] : NULL)) {
+				fprintf(stderr, "fuzz %" PRIu64 ": map_get(%s) returned a wrong value\n", i, keys[key]);
+				failures++;
+			}
+		}
+
+		if (i % 10000 != 0) continue;
+
+		// the size and the statistics must match the model
+		unsigned int size = 0;
+		for (k = 0; k < KEYS; k++) size += present[k];
+		map_stats_t stats;
+		unsigned int histogram = 0;
+		map_stats(&map, &stats);
+		for (k = 0; k < MAP_STATS_HISTOGRAM; k++) histogram += stats.histogram[k];
+		if ((unsigned int)map_size(&map) != size || histogram != size || stats.tombstones != stats.allocated - stats.size) {
+			fprintf(stderr, "fuzz %" PRIu64 ": size %d, model %u, histogram %u\n", i, map_size(&map), size, histogram);
+			failures++;
+		}
+
+		// a snapshot of the map must be valid and hold the same keys and values
+		FILE* stream = tmpfile();
+		if (stream == NULL) continue;
+		map_t loaded;
+		static const int kinds[] = { MAP_HASH_SIPHASH, MAP_HASH_FNV1, MAP_HASH_CRC32C };
+		map_init_hash(&loaded, kinds[i / 10000 % 3], map.seed);
+		if (i / 10000 % 2) map_filter(&loaded, 1);
+		int result = map_serialize(&map, stream);
+		rewind(stream);
+		if (result == OK) result = map_validate(stream);
+		rewind(stream);
+		if (result == OK) result = map_deserialize(&loaded, stream);
+		fclose(stream);
+		if (result != OK || map_size(&loaded) != map_size(&map)) {
+			fprintf(stderr, "fuzz %" PRIu64 ": snapshot round trip returned %d\n", i, result);
+			failures++;
+		}
+		for (k = 0; k < KEYS && result == OK; k++) {
+			const char* value = map_get(&loaded, keys[k]);
+			const char* expected = present[k] ? model[k] : NULL;
+			if ((value == NULL) != (expected == NULL) || (value != NULL && strcmp(value, expected) != 0)) {
+				fprintf(stderr, "fuzz %" PRIu64 ": the snapshot has a wrong value for %s\n", i, keys[k]);
+				failures++;
+				break;
+			}
+		}
+		map_destroy(&loaded);
+	}
+	map_destroy(&map);
+
+	if (failures == 0) printf("map_perf: fuzz ok, %" PRIu64 " operations\n", operations);
+	return failures;
+}
+
+int main(int argc, char** argv) {
+	size_t count = 1 << 20;
+	unsigned int runs = 3;
+	uint64_t seed = 0x9E3779B97F4A7C15ULL;
+	uint64_t fuzz = 0;
+	double tolerance = 10;
+	const char* write = NULL;
+	const char* compare = NULL;
+	int option;
+	while ((option = getopt(argc, argv, "n:r:s:w:c:t:f:")) != -1) {
+		switch (option) {
+		case 'n': count = strtoull(optarg, NULL, 0); break;
+		case 'r': runs = (unsigned int)strtoul(optarg, NULL, 0); break;
+		case 's': seed = strtoull(optarg, NULL, 0); break;
+		case 'w': write = optarg; break;
+		case 'c': compare = optarg; break;
+		case 't': tolerance = strtod(optarg, NULL); break;
+		case 'f': fuzz = strtoull(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "usage: %s [-n keys] [-r runs] [-s seed] [-w baseline] [-c baseline] [-t tolerance] [-f operations]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (count < 1024) count = 1024;
+	if (runs < 1) runs = 1;
+	if (runs > 64) runs = 64;
+	perf_state = seed != 0 ? seed : 1;
+
+	if (fuzz > 0) return perf_fuzz(fuzz) == 0 ? 0 : 1;
+
+	perf_keys_t keys;
+	double* cdf = malloc(sizeof(double) * count);
+	if (perf_keys(&keys, count, '-') != 0 || cdf == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	// the cumulative zipfian distribution of the ranks
+	double sum = 0;
+	size_t i;
+	for (i = 0; i < count; i++) sum += 1 / pow((double)(i + 1), 0.99);
+	double cumulative = 0;
+	for (i = 0; i < count; i++) {
+		cumulative += 1 / pow((double)(i + 1), 0.99) / sum;
+		cdf[i] = cumulative;
+	}
+	cdf[count - 1] = 1;
+
+	perf_run_t run;
+	memset(&run, 0, sizeof(run));
+	perf_counters_open(&run);
+
+	enum { BULK_PUT, BULK_LOAD, ZIPF, SESSIONS, WORKLOADS };
+	perf_result_t results[WORKLOADS] = { { "bulk-put", { 0 } }, { "bulk-load", { 0 } }, { "zipf", { 0 } }, { "sessions", { 0 } } };
+	double (*measured)[64][PERF_METRICS] = calloc(WORKLOADS, sizeof(*measured));
+	if (measured == NULL) return 1;
+
+	unsigned int r;
+	for (r = 0; r < runs; r++) {
+		// every run replays the same workload
+		perf_state = seed != 0 ? seed + r : 1;
+		perf_bulk(&run, &keys, measured[BULK_PUT][r], measured[BULK_LOAD][r]);
+		perf_zipf(&run, &keys, cdf, measured[ZIPF][r]);
+		perf_sessions(&run, &keys, measured[SESSIONS][r]);
+	}
+
+	printf("%-10s", "workload");
+	int m;
+	for (m = 0; m < PERF_METRICS; m++) printf(" %16s", perf_metric_names[m]);
+	printf("\n");
+	unsigned int w;
+	for (w = 0; w < WORKLOADS; w++) {
+		perf_median(results + w, measured[w], runs);
+		printf("%-10s", results[w].name);
+		for (m = 0; m < PERF_METRICS; m++) {
+			if (results[w].metrics[m] < 0) printf(" %16s", "n/a");
+			else printf(" %16.2f", results[w].metrics[m]);
+		}
+		printf("\n");
+	}
+
+	int status = 0;
+	if (write != NULL) status |= perf_write_baseline(write, results, WORKLOADS);
+	if (compare != NULL && perf_compare_baseline(compare, results, WORKLOADS, tolerance) > 0) status = 1;
+	if (compare != NULL && status == 0) printf("map_perf: no regressions against %s\n", compare);
+
+	perf_counters_close(&run);
+	free(run.samples);
+	free(measured);
+	free(cdf);
+	perf_keys_free(&keys);
+	return status;
+}
@@ -0,0 +1,266 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "bmap.h"
+#include "map_internal.h"
+
+// note: must be 2^n, default is 8
+#define BMAP_MIN_EMPTY_SLOTS (1 << 3)
+
+#define BMAP_MAGIC 0x1234567890123459
+
+_Static_assert(sizeof(bmap_entry_t) == 32, "a slot of the blob map must be 32 bytes");
+
+
+//
+//	The blob map probes, removes and rebuilds like the map, only its slots hold the values instead of pointers to
+//	them. Only the slot is read to return a value of up to BMAP_INLINE bytes, larger values are read through a pointer.
+//	Every larger value has its own allocation, it is freed when its key is removed. A rebuild moves the pointers
+//	with the slots and does not touch the values.
+//
+
+
+//
+//	Returns the pointer to the copy of a value longer than BMAP_INLINE.
+//
+//	@param entry
+//		the slot of the value.
+//	@return
+//		the pointer stored in the slot.
+//
+static void* bmap_copy(const bmap_entry_t* entry) {
+	void* copy;
+	memcpy(&copy, entry->value, sizeof(copy));
+	return copy;
+}
+
+//
+//	Searches for the provided key and returns its slot or -1 if the key is not in the map, like map_indexOf.
+//
+//	@param self
+//		the blob map to search in.
+//	@param key
+//		the key to search for.
+//	@param hash
+//		the modified FNV1 hash above the key.
+//	@return
+//		the slot of the key or -1 if this key is not in the map.
+//
+static int bmap_indexOf(bmap_t* self, const char* key, const int64_t hash) {
+	const unsigned int mask = self->capacity - 1;
+	const bmap_entry_t* entries = self->entries;
+	unsigned int i = hash & mask;
+	unsigned int l = self->capacity;
+
+	while (l-- > 0) {
+		const bmap_entry_t* entry = entries + i;
+
+		// as soon as we hit an empty hash we can be sure that this key is not in the map
+		if (entry->hash == 0) return -1;
+		if (entry->hash == hash && entry->key != NULL && (entry->key == key || strcmp(entry->key, key) == 0)) return i;
+
+		i = (i+1) & mask;
+	}
+	return -1;
+}
+
+//
+//	Rebuilds the blob map with at least the provided amount of slots. The slots are copied as they are (the
+//	inline values and the pointers to the larger ones) and the deleted ones are dropped.
+//
+//	@param self
+//		the pointer to the blob map struct.
+//	@param minNewSize
+//		the minimal amount of slots the map must have afterwards.
+//	@return
+//		OK or SYS_ERROR.
+//
+static int bmap_rebuild(bmap_t* self, const unsigned int minNewSize) {
+	unsigned int newLength = BMAP_MIN_EMPTY_SLOTS;
+	while (newLength < minNewSize) newLength <<= 1;
+	bmap_entry_t* newEntries = calloc(newLength, sizeof(bmap_entry_t));
+	if (newEntries == NULL) return SYS_ERROR;
+
+	const unsigned int mask = newLength - 1;
+	unsigned int j;
+	for (j = 0; j < self->capacity; j++) {
+		const bmap_entry_t* entry = self->entries + j;
+		if (entry->key == NULL) continue;
+
+		// no key can exist twice so we only need to find an empty slot
+		unsigned int i = entry->hash & mask;
+		while (newEntries[i].hash != 0) i = (i+1) & mask;
+		newEntries[i] = *entry;
+	}
+
+	free(self->entries);
+	self->entries = newEntries;
+	self->capacity = newLength;
+	self->allocated = self->size;
+	return OK;
+}
+
+//
+//	Initializes the given blob map and allocates memory to the map.
+//
+//	@param self
+//		the blob map to be initialized.
+//
+void bmap_init(bmap_t* self) {
+	if (self == NULL) return;
+	self->magic = BMAP_MAGIC;
+	self->capacity = BMAP_MIN_EMPTY_SLOTS;
+	self->size = 0;
+	self->allocated = 0;
+	self->entries = calloc(self->capacity, sizeof(bmap_entry_t));
+}
+
+//
+//	Assigns a copy of the provided value to the provided key and returns OK if this was successfull or KEY_EXISTS
+//	if the key exists already.
+//
+//	@param self
+//		the blob map in which to put the key-value pair.
+//	@param key
+//		the key, it is not copied.
+//	@param value
+//		the bytes of the value, may be NULL if the length is zero.
+//	@param length
+//		the amount of bytes of the value.
+//	@return
+//		OK if the key-value pair was inserted, KEY_EXISTS is the key is already set or SYS_ERROR if there is no
+//		memory for the value or the map could not grow.
+//
+int bmap_put(bmap_t* self, const char* key, const void* value, const uint32_t length) {
+	if (self == NULL || key == NULL || (value == NULL && length > 0)) return NULL_POINTER;
+	if (self->magic != BMAP_MAGIC) return NOT_INITIALIZED;
+
+	const int64_t hash = fnv1_hash(key);
+	if (bmap_indexOf(self, key, hash) >= 0) return KEY_EXISTS;
+
+	// if there is not enough space to add another key-value pair, make space
+	if (self->allocated >= self->capacity && bmap_rebuild(self, self->size + BMAP_MIN_EMPTY_SLOTS) != OK) {
+		return SYS_ERROR;
+	}
+
+	// the larger values are copied before the slot is taken, so a missing memory leaves the map unchanged
+	void* copy = NULL;
+	if (length > BMAP_INLINE) {
+		copy = malloc(length);
+		if (copy == NULL) return SYS_ERROR;
+		memcpy(copy, value, length);
+	}
+
+	// the first empty slot or the slot of a deleted key with the same hash, like map_set
+	const unsigned int mask = self->capacity - 1;
+	unsigned int i = hash & mask;
+	unsigned int probe = 1;
+	while (self->entries[i].hash != 0 && (self->entries[i].hash != hash || self->entries[i].key != NULL)) {
+		i = (i+1) & mask;
+		probe++;
+	}
+
+	bmap_entry_t* entry = self->entries + i;
+	if (entry->hash == 0) self->allocated++;
+	entry->key = key;
+	entry->hash = hash;
+	entry->length = length;
+	if (length > BMAP_INLINE) {
+		memcpy(entry->value, &copy, sizeof(copy));
+	} else if (length > 0) {
+		memcpy(entry->value, value, length);
+	}
+	self->size++;
+
+	// the rebuild moves the slots with their values, the copies of the larger values stay where they are
+	const unsigned int slots = map_probe_bound(probe, self->size, self->allocated, self->capacity, BMAP_MIN_EMPTY_SLOTS);
+	if (slots > 0) bmap_rebuild(self, slots);
+	return OK;
+}
+
+//
+//	Looks up for the provided key and returns a view of its value. The view of a value of up to BMAP_INLINE bytes
+//	points into the slot, so it is only valid until the map is changed.
+//
+//	@param self
+//		the blob map into which to look for the key.
+//	@param key
+//		the key to search.
+//	@param view
+//		receives the pointer to the bytes of the value and their amount.
+//	@return
+//		OK, NO_KEY_EXISTS, NULL_POINTER or NOT_INITIALIZED.
+//
+int bmap_get(bmap_t* self, const char* key, bmap_value_t* view) {
+	if (self == NULL || key == NULL || view == NULL) return NULL_POINTER;
+	if (self->magic != BMAP_MAGIC) return NOT_INITIALIZED;
+
+	const int i = bmap_indexOf(self, key, fnv1_hash(key));
+	if (i < 0) return NO_KEY_EXISTS;
+
+	const bmap_entry_t* entry = self->entries + i;
+	view->length = entry->length;
+	if (entry->length > BMAP_INLINE) {
+		view->data = bmap_copy(entry);
+	} else {
+		view->data = entry->value;
+	}
+	return OK;
+}
+
+//
+//	Removes the key-value pair with the given key from the blob map.
+//
+//	@param self
+//		the blob map from which to remove the key-value pair.
+//	@param key
+//		the key of the entity to be removed.
+//	@return
+//		OK if the key-value pair was removed successfully or NO_KEY_EXISTS if the provided map doesn't contain such
+//		a key.
+//
+int bmap_remove(bmap_t* self, const char* key) {
+	if (self == NULL || key == NULL) return NULL_POINTER;
+	if (self->magic != BMAP_MAGIC) return NOT_INITIALIZED;
+
+	const int i = bmap_indexOf(self, key, fnv1_hash(key));
+	if (i < 0) return NO_KEY_EXISTS;
+	bmap_entry_t* entry = self->entries + i;
+	if (entry->length > BMAP_INLINE) free(bmap_copy(entry));
+	entry->key = NULL;
+	self->size--;
+	return OK;
+}
+
+//
+//	Returns the amount of key-value pairs stored in the provided blob map.
+//
+//	@param self
+//		the blob map for which to return the size.
+//	@return
+//		the amount of key-value pairs stored in the provided map.
+//
+int bmap_size(bmap_t* self) {
+	if (self == NULL || self->magic != BMAP_MAGIC) return 0;
+	return self->size;
+}
+
+//
+//	Frees the memory allocated for the blob map, including the copies of the values.
+//
+//	@param self
+//		the blob map to destroy and for which to release memory.
+//
+void bmap_destroy(bmap_t* self) {
+	if (self == NULL) return;
+	if (self->magic != BMAP_MAGIC) return;
+
+	unsigned int i;
+	for (i = 0; self->entries != NULL && i < self->capacity; i++) {
+		const bmap_entry_t* entry = self->entries + i;
+		if (entry->key != NULL && entry->length > BMAP_INLINE) free(bmap_copy(entry));
+	}
+	free(self->entries);
+	self->entries = NULL;
+	self->magic = 0;
+}
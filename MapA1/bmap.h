@@ -0,0 +1,62 @@
+#ifndef __A1_BMAP_H__
+#define __A1_BMAP_H__
+
+#include <stddef.h>
+#include "map.h"
+
+//
+//	The blob map is a variant of the map whose values are byte arrays of any length instead of strings. The values
+//	are copied into the map: a value of up to BMAP_INLINE bytes is stored in the slot itself, so reading it costs no
+//	further cache miss, a larger value is copied into memory of its own that the map frees with its key. The keys are
+//	not copied, like the keys of the map.
+//
+
+// the largest value stored in the slot
+#define BMAP_INLINE 12
+
+// a slot, 32 bytes
+typedef struct {
+	// if the key is NULL, then this entry counts as deleted
+	const char* key;
+
+	// the hash value of the key, zero if the slot is empty
+	int64_t hash;
+
+	// the length of the value in bytes
+	uint32_t length;
+
+	// the value if it is not longer than BMAP_INLINE, otherwise the pointer to the copy
+	unsigned char value[BMAP_INLINE];
+} bmap_entry_t;
+
+// a value returned by bmap_get, valid until the map is changed
+typedef struct {
+	const void* data;
+	size_t length;
+} bmap_value_t;
+
+// the root blob map struct
+typedef struct {
+	// used to detect that the map was initialized
+	int64_t magic;
+
+	// a pointer to the entries (basically an array of slots)
+	bmap_entry_t* entries;
+
+	// the amount of valid entries in the map
+	unsigned int size;
+
+	// the amount of slots being allocated, that means that have fixed hash values
+	unsigned int allocated;
+
+	// the total amount of entries (slots), always 2^n
+	unsigned int capacity;
+} bmap_t;
+
+void bmap_init(bmap_t*);
+int bmap_put(bmap_t*, const char*, const void*, uint32_t);
+int bmap_get(bmap_t*, const char*, bmap_value_t*);
+int bmap_remove(bmap_t*, const char*);
+int bmap_size(bmap_t*);
+void bmap_destroy(bmap_t*);
+#endif
@@ -0,0 +1,445 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "cmap.h"
+#include "map_internal.h"
+
+// note: must be 2^n
+#define CMAP_MIN_BUCKETS (1 << 2)
+
+#define CMAP_MAGIC 0x123456789012345B
+
+// the map grows before an insert would fill more than this percentage of the slots
+#define CMAP_MAX_LOAD 90
+
+// the amount of keys an insert moves at most before the map grows
+#define CMAP_MAX_KICKS 500
+
+// the test replaces the allocation of the buckets to make a rebuild fail
+#ifdef CMAP_TESTING
+void* (*cmap_allocate)(size_t, size_t) = aligned_alloc;
+#else
+#define cmap_allocate aligned_alloc
+#endif
+
+_Static_assert(sizeof(cmap_bucket_t) == 64, "a bucket of the cuckoo map must be a cache line");
+
+// a key being placed, with its value and tag
+typedef struct {
+	const char* key;
+	const char* value;
+	uint32_t tag;
+} cmap_item_t;
+
+
+//
+//	The 64-bit hash of a key is split into two halves: the low bits select the first bucket and the high half is
+//	the tag stored with the key. The second bucket is the first one XOR a mix of the tag, so the other bucket of a
+//	key is known from the bucket it is in and its tag, without hashing the key again. A lookup compares the tags of
+//	both buckets and only compares the keys whose tags match.
+//
+//	If both buckets of a new key are full, a random key of them is replaced by the new key and moves into its other
+//	bucket, possibly replacing another key, up to CMAP_MAX_KICKS times (random walk cuckoo hashing). If that fails
+//	or the map is CMAP_MAX_LOAD percent full, the map is rebuilt with twice the buckets.
+//
+//	The keys are hashed with FNV1, mixed so that both halves depend on all bits. More than 2 * CMAP_WAYS keys with
+//	the same hash can never be placed, however large the map is. So if a rebuild cannot place all keys, which does
+//	not happen by chance as the rebuilt map is less than half full, the map switches to SipHash with a random key
+//	instead of growing, like map_bound does. Nobody can compute keys colliding with that hash.
+//
+//	A removed key just empties its slot, there are no deleted slots as in the map.
+//
+
+
+//
+//	Returns the other bucket of a key.
+//
+//	@param i
+//		the bucket the key is in.
+//	@param tag
+//		the tag of the key.
+//	@param mask
+//		the amount of buckets minus one.
+//	@return
+//		the other bucket, i for some tags.
+//
+static inline unsigned int cmap_alternate(const unsigned int i, const uint32_t tag, const unsigned int mask) {
+	return (i ^ (tag * 0x5BD1E995U)) & mask;
+}
+
+//
+//	Calculates the hash of a key and splits it into the first bucket and the tag.
+//
+static inline unsigned int cmap_hash(const cmap_t* self, const char* key, const unsigned int mask, uint32_t* tag) {
+	uint64_t hash;
+	if (self->hashKind == MAP_HASH_SIPHASH) {
+		hash = map_siphash(self->seed, key, strlen(key));
+	} else {
+		// the halves of the FNV1 hashes of similar keys are related, the tag and the bucket must not be
+		hash = map_mix((uint64_t)fnv1_hash(key));
+	}
+	*tag = (uint32_t)(hash >> 32);
+	if (*tag == 0) *tag = 1;
+	return (unsigned int)hash & mask;
+}
+
+#ifdef CMAP_TESTING
+//
+//	Returns the buckets of a key in a map with the provided amount of buckets, with the current hash function of the
+//	map. The test uses it to find keys that share their buckets.
+//
+//	@param self
+//		the cuckoo map.
+//	@param key
+//		the key.
+//	@param capacity
+//		the amount of buckets, 2^n.
+//	@param first
+//		receives the bucket selected by the hash.
+//	@param second
+//		receives the other bucket.
+//
+void cmap_buckets(const cmap_t* self, const char* key, const unsigned int capacity, unsigned int* first,
+		unsigned int* second) {
+	uint32_t tag;
+	*first = cmap_hash(self, key, capacity - 1, &tag);
+	*second = cmap_alternate(*first, tag, capacity - 1);
+}
+#endif
+
+//
+//	Returns a random number to choose the key to move (xorshift64*).
+//
+static inline uint64_t cmap_random(cmap_t* self) {
+	uint64_t x = self->random;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	self->random = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+//
+//	Stores an item into an empty slot of a bucket.
+//
+//	@return
+//		1 if the item was stored, 0 if the bucket is full.
+//
+static inline int cmap_store(cmap_bucket_t* bucket, const cmap_item_t* item) {
+	int w;
+	for (w = 0; w < CMAP_WAYS; w++) {
+		if (bucket->tags[w] != 0) continue;
+		bucket->tags[w] = item->tag;
+		bucket->keys[w] = item->key;
+		bucket->values[w] = item->value;
+		return 1;
+	}
+	return 0;
+}
+
+//
+//	Places an item into one of its buckets, moving other keys into their other buckets if both are full.
+//
+//	@param self
+//		the pointer to the cuckoo map struct, for the random numbers.
+//	@param buckets
+//		the buckets to place the item into.
+//	@param mask
+//		the amount of buckets minus one.
+//	@param item
+//		the item to place, receives the item without a place if this fails.
+//	@param i
+//		the first bucket of the item.
+//	@param path
+//		receives the CMAP_MAX_KICKS slots whose keys were replaced if this fails (see cmap_unwind), may be NULL.
+//	@return
+//		1 if all items have a place, 0 if the item now in item has none.
+//
+static int cmap_place(cmap_t* self, cmap_bucket_t* buckets, const unsigned int mask, cmap_item_t* item, unsigned int i,
+		uint64_t* path) {
+	const unsigned int j = cmap_alternate(i, item->tag, mask);
+	if (cmap_store(buckets + i, item) || cmap_store(buckets + j, item)) return 1;
+
+	unsigned int kicks;
+	for (kicks = 0; kicks < CMAP_MAX_KICKS; kicks++) {
+		// the item takes the slot of a random key of one of its buckets, which moves into its other bucket
+		const uint64_t r = cmap_random(self);
+		if (kicks == 0 && (r & 1)) i = j;
+		cmap_bucket_t* bucket = buckets + i;
+		const unsigned int w = (unsigned int)((r >> 1) % CMAP_WAYS);
+		if (path != NULL) path[kicks] = (uint64_t)i * CMAP_WAYS + w;
+		const cmap_item_t victim = { bucket->keys[w], bucket->values[w], bucket->tags[w] };
+		bucket->tags[w] = item->tag;
+		bucket->keys[w] = item->key;
+		bucket->values[w] = item->value;
+		*item = victim;
+
+		i = cmap_alternate(i, item->tag, mask);
+		if (cmap_store(buckets + i, item)) return 1;
+	}
+	return 0;
+}
+
+//
+//	Moves the keys replaced by a failed cmap_place back into their slots, so the map is as before and the item
+//	without a place is the one cmap_place was called with.
+//
+//	@param self
+//		the pointer to the cuckoo map struct.
+//	@param path
+//		the slots filled by cmap_place.
+//	@param item
+//		the item without a place, receives the item cmap_place was called with.
+//
+static void cmap_unwind(cmap_t* self, const uint64_t* path, cmap_item_t* item) {
+	unsigned int k = CMAP_MAX_KICKS;
+	while (k-- > 0) {
+		cmap_bucket_t* bucket = self->buckets + path[k] / CMAP_WAYS;
+		const unsigned int w = (unsigned int)(path[k] % CMAP_WAYS);
+		const cmap_item_t replaced = { bucket->keys[w], bucket->values[w], bucket->tags[w] };
+		bucket->tags[w] = item->tag;
+		bucket->keys[w] = item->key;
+		bucket->values[w] = item->value;
+		*item = replaced;
+	}
+}
+
+//
+//	Rebuilds the map with at least the provided amount of buckets, hashing all keys again. If the keys do not fit,
+//	the map switches from FNV1 to SipHash the first time and doubles the amount of buckets after that, until they
+//	fit. If the map cannot grow it keeps its hash function and seed, its keys are where they were.
+//
+//	@param self
+//		the pointer to the cuckoo map struct.
+//	@param minBuckets
+//		the minimal amount of buckets the map must have afterwards.
+//	@param extra
+//		a key to place in addition to the ones of the map or NULL.
+//	@return
+//		OK or SYS_ERROR.
+//
+static int cmap_rebuild(cmap_t* self, unsigned int minBuckets, const cmap_item_t* extra) {
+	unsigned int length = CMAP_MIN_BUCKETS;
+	while (length < minBuckets) length <<= 1;
+	const int hashKind = self->hashKind;
+	const uint64_t seed[2] = { self->seed[0], self->seed[1] };
+
+	while (length != 0) {
+		cmap_bucket_t* buckets = cmap_allocate(sizeof(cmap_bucket_t), sizeof(cmap_bucket_t) * (size_t)length);
+		if (buckets == NULL) break;
+		memset(buckets, 0, sizeof(cmap_bucket_t) * (size_t)length);
+		const unsigned int mask = length - 1;
+
+		int placed = 1;
+		unsigned int b;
+		int w;
+		for (b = 0; b <= self->capacity && placed; b++) {
+			for (w = 0; w < CMAP_WAYS && placed; w++) {
+				// the extra key is placed after all keys of the map
+				cmap_item_t item;
+				if (b < self->capacity) {
+					const cmap_bucket_t* bucket = self->buckets + b;
+					if (bucket->tags[w] == 0) continue;
+					item.key = bucket->keys[w];
+					item.value = bucket->values[w];
+				} else {
+					if (extra == NULL || w > 0) continue;
+					item = *extra;
+				}
+				const unsigned int i = cmap_hash(self, item.key, mask, &item.tag);
+				placed = cmap_place(self, buckets, mask, &item, i, NULL);
+			}
+		}
+
+		if (placed) {
+			free(self->buckets);
+			self->buckets = buckets;
+			self->capacity = length;
+			return OK;
+		}
+		free(buckets);
+		if (self->hashKind != MAP_HASH_SIPHASH) {
+			self->hashKind = MAP_HASH_SIPHASH;
+			map_hash_seed(self->seed);
+			continue;
+		}
+		length = length < 0x40000000 ? length << 1 : 0;
+	}
+	self->hashKind = hashKind;
+	self->seed[0] = seed[0];
+	self->seed[1] = seed[1];
+	return SYS_ERROR;
+}
+
+//
+//	Searches for the provided key and returns its bucket and slot.
+//
+//	@param self
+//		the cuckoo map to search in.
+//	@param key
+//		the key to search for.
+//	@param way
+//		receives the slot of the key in the bucket.
+//	@return
+//		the bucket of the key or NULL if this key is not in the map.
+//
+static cmap_bucket_t* cmap_find(cmap_t* self, const char* key, int* way) {
+	const unsigned int mask = self->capacity - 1;
+	uint32_t tag;
+	const unsigned int i = cmap_hash(self, key, mask, &tag);
+	const unsigned int j = cmap_alternate(i, tag, mask);
+
+	// both lines are requested before the first one is compared
+	__builtin_prefetch(self->buckets + j);
+	cmap_bucket_t* bucket = self->buckets + i;
+	int pass;
+	for (pass = 0; pass < 2; pass++) {
+		int w;
+		for (w = 0; w < CMAP_WAYS; w++) {
+			if (bucket->tags[w] != tag) continue;
+			if (bucket->keys[w] == key || strcmp(bucket->keys[w], key) == 0) {
+				*way = w;
+				return bucket;
+			}
+		}
+		bucket = self->buckets + j;
+	}
+	return NULL;
+}
+
+//
+//	Initializes the given cuckoo map and allocates memory to the map.
+//
+//	@param self
+//		the cuckoo map to be initialized.
+//	@return
+//		OK, NULL_POINTER or SYS_ERROR if there is no memory, then the map is not initialized.
+//
+int cmap_init(cmap_t* self) {
+	if (self == NULL) return NULL_POINTER;
+	self->magic = 0;
+	self->size = 0;
+	self->capacity = 0;
+	self->buckets = NULL;
+	self->hashKind = MAP_HASH_FNV1;
+	self->seed[0] = 0;
+	self->seed[1] = 0;
+	self->random = 0x9E3779B97F4A7C15ULL;
+	if (cmap_rebuild(self, CMAP_MIN_BUCKETS, NULL) != OK) return SYS_ERROR;
+	self->magic = CMAP_MAGIC;
+	return OK;
+}
+
+//
+//	Assigns the provided value to the provided key and returns OK if this was successfull or KEY_EXISTS if the key
+//	exists already.
+//
+//	@param self
+//		the cuckoo map in which to put the key-value pair.
+//	@param key
+//		the key.
+//	@param value
+//		the value.
+//	@return
+//		OK if the key-value pair was inserted, KEY_EXISTS is the key is already set or SYS_ERROR if the map could
+//		not grow.
+//
+int cmap_put(cmap_t* self, const char* key, const char* value) {
+	if (self == NULL || key == NULL) return NULL_POINTER;
+	if (self->magic != CMAP_MAGIC) return NOT_INITIALIZED;
+
+	int way;
+	if (cmap_find(self, key, &way) != NULL) return KEY_EXISTS;
+
+	cmap_item_t item = { key, value, 0 };
+	const uint64_t slots = (uint64_t)self->capacity * CMAP_WAYS;
+	if ((uint64_t)(self->size + 1) * 100 > slots * CMAP_MAX_LOAD) {
+		if (cmap_rebuild(self, self->capacity * 2, &item) != OK) return SYS_ERROR;
+		self->size++;
+		return OK;
+	}
+
+	const unsigned int mask = self->capacity - 1;
+	const unsigned int i = cmap_hash(self, key, mask, &item.tag);
+	uint64_t path[CMAP_MAX_KICKS];
+	if (!cmap_place(self, self->buckets, mask, &item, i, path)) {
+		// another key was moved out and has no place, it is placed while the map grows, if the map cannot grow all
+		// keys move back and the new key is not added
+		if (cmap_rebuild(self, self->capacity * 2, &item) != OK) {
+			cmap_unwind(self, path, &item);
+			return SYS_ERROR;
+		}
+	}
+	self->size++;
+	return OK;
+}
+
+//
+//	Looks up for the provided key and returns its value.
+//
+//	@param self
+//		the cuckoo map into which to look for the key.
+//	@param key
+//		the key to search.
+//	@return
+//		the value (which might be null either!) of the key or null is no such key exists in the map.
+//
+const char* cmap_get(cmap_t* self, const char* key) {
+	if (self == NULL || key == NULL || self->magic != CMAP_MAGIC) return NULL;
+	int way;
+	const cmap_bucket_t* bucket = cmap_find(self, key, &way);
+	return bucket != NULL ? bucket->values[way] : NULL;
+}
+
+//
+//	Removes the key-value pair with the given key from the cuckoo map.
+//
+//	@param self
+//		the cuckoo map from which to remove the key-value pair.
+//	@param key
+//		the key of the entity to be removed.
+//	@return
+//		OK if the key-value pair was removed successfully or NO_KEY_EXISTS if the provided map doesn't contain such
+//		a key.
+//
+int cmap_remove(cmap_t* self, const char* key) {
+	if (self == NULL || key == NULL) return NULL_POINTER;
+	if (self->magic != CMAP_MAGIC) return NOT_INITIALIZED;
+
+	int way;
+	cmap_bucket_t* bucket = cmap_find(self, key, &way);
+	if (bucket == NULL) return NO_KEY_EXISTS;
+	bucket->tags[way] = 0;
+	bucket->keys[way] = NULL;
+	bucket->values[way] = NULL;
+	self->size--;
+	return OK;
+}
+
+//
+//	Returns the amount of key-value pairs stored in the provided cuckoo map.
+//
+//	@param self
+//		the cuckoo map for which to return the size.
+//	@return
+//		the amount of key-value pairs stored in the provided map.
+//
+int cmap_size(cmap_t* self) {
+	if (self == NULL || self->magic != CMAP_MAGIC) return 0;
+	return self->size;
+}
+
+//
+//	Frees the memory allocated for the cuckoo map.
+//
+//	@param self
+//		the cuckoo map to destroy and for which to release memory.
+//
+void cmap_destroy(cmap_t* self) {
+	if (self == NULL) return;
+	if (self->magic != CMAP_MAGIC) return;
+
+	free(self->buckets);
+	self->buckets = NULL;
+	self->magic = 0;
+}
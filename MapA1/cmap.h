@@ -0,0 +1,61 @@
+#ifndef __A1_CMAP_H__
+#define __A1_CMAP_H__
+
+#include "map.h"
+
+//
+//	The cuckoo map is a variant of the map with a bounded lookup: every key has two buckets of CMAP_WAYS slots, one
+//	cache line each, and is always in one of them, so a lookup reads at most two lines of the table however full it
+//	is. An insert into two full buckets moves a key of them into its other bucket, and so on. The keys and values
+//	are not copied, like in the map.
+//
+
+// the slots of a bucket, three fit into a cache line together with their tags
+#define CMAP_WAYS 3
+
+// a bucket, 64 bytes
+typedef struct {
+	// 32 bits of the hash of the key in each slot, never 0, 0 marks an empty slot
+	uint32_t tags[CMAP_WAYS];
+	uint32_t unused;
+
+	const char* keys[CMAP_WAYS];
+	const char* values[CMAP_WAYS];
+} __attribute__((aligned(64))) cmap_bucket_t;
+
+// the root cuckoo map struct
+typedef struct {
+	// used to detect that the map was initialized
+	int64_t magic;
+
+	// a pointer to the buckets
+	cmap_bucket_t* buckets;
+
+	// the amount of valid entries in the map
+	unsigned int size;
+
+	// the total amount of buckets, always 2^n
+	unsigned int capacity;
+
+	// the hash function of the keys (MAP_HASH_FNV1 or MAP_HASH_SIPHASH after the keys could not be placed) and the
+	// key of the SipHash
+	int hashKind;
+	uint64_t seed[2];
+
+	// the state of the generator choosing the keys to move
+	uint64_t random;
+} cmap_t;
+
+int cmap_init(cmap_t*);
+int cmap_put(cmap_t*, const char*, const char*);
+const char* cmap_get(cmap_t*, const char*);
+int cmap_remove(cmap_t*, const char*);
+int cmap_size(cmap_t*);
+void cmap_destroy(cmap_t*);
+
+// Test hooks, only compiled in if CMAP_TESTING is defined (see test/cmap_test.c).
+#ifdef CMAP_TESTING
+extern void* (*cmap_allocate)(size_t, size_t);
+void cmap_buckets(const cmap_t*, const char*, unsigned int, unsigned int*, unsigned int*);
+#endif
+#endif
@@ -0,0 +1,116 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "counters.h"
+#include "map_internal.h"
+
+// the line of the current thread, NULL until it counts the first time
+__thread map_counter_line_t* map_counter_line = NULL;
+
+// the lines of the running threads, the sums of the ended threads and the sums at the last reset
+static map_counter_line_t* counters_lines = NULL;
+static uint64_t counters_ended[MAP_COUNTER_COUNT];
+static uint64_t counters_base[MAP_COUNTER_COUNT];
+static pthread_mutex_t counters_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// releases the line of a thread when it ends
+static pthread_key_t counters_key;
+static pthread_once_t counters_once = PTHREAD_ONCE_INIT;
+
+
+//
+//	Adds the line of an ending thread to the sums of the ended threads and releases it.
+//
+static void counters_release(void* argument) {
+	map_counter_line_t* line = argument;
+	pthread_mutex_lock(&counters_lock);
+	int c;
+	for (c = 0; c < MAP_COUNTER_COUNT; c++) counters_ended[c] += line->counts[c];
+	map_counter_line_t** p = &counters_lines;
+	while (*p != line) p = &(*p)->next;
+	*p = line->next;
+	pthread_mutex_unlock(&counters_lock);
+
+	free(line);
+	map_counter_line = NULL;
+}
+
+static void counters_init() {
+	pthread_key_create(&counters_key, counters_release);
+}
+
+//
+//	Adds the counters of all threads up into the provided sums.
+//
+static void counters_sum(uint64_t* sums) {
+	int c;
+	for (c = 0; c < MAP_COUNTER_COUNT; c++) sums[c] = counters_ended[c];
+	map_counter_line_t* line;
+	for (line = counters_lines; line != NULL; line = line->next) {
+		for (c = 0; c < MAP_COUNTER_COUNT; c++) sums[c] += __atomic_load_n(&line->counts[c], __ATOMIC_RELAXED);
+	}
+}
+
+//
+//	Creates the line of the current thread, called when the thread counts the first time.
+//
+//	@return
+//		the line or NULL if there is no memory, then the thread does not count.
+//
+map_counter_line_t* map_counters_register() {
+	pthread_once(&counters_once, counters_init);
+
+	void* memory;
+	if (posix_memalign(&memory, MAP_CACHE_LINE, sizeof(map_counter_line_t)) != 0) return NULL;
+	map_counter_line_t* line = memset(memory, 0, sizeof(map_counter_line_t));
+	if (pthread_setspecific(counters_key, line) != 0) {
+		free(line);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&counters_lock);
+	line->next = counters_lines;
+	counters_lines = line;
+	pthread_mutex_unlock(&counters_lock);
+
+	map_counter_line = line;
+	return line;
+}
+
+//
+//	Returns the monotonic time in nanoseconds, used to measure the time spent rebuilding.
+//
+uint64_t map_counters_now() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+//
+//	Adds up the counters of all threads since the last map_counters_reset. The threads continue to count while
+//	this runs, so the sums are not taken at one instant.
+//
+//	@param counters
+//		the sums to fill.
+//
+void map_counters_read(map_counters_t* counters) {
+	if (counters == NULL) return;
+
+	pthread_mutex_lock(&counters_lock);
+	counters_sum(counters->counts);
+	int c;
+	for (c = 0; c < MAP_COUNTER_COUNT; c++) counters->counts[c] -= counters_base[c];
+	pthread_mutex_unlock(&counters_lock);
+}
+
+//
+//	Starts counting from zero. The lines of the threads are not touched, only the current sums are remembered and
+//	subtracted by map_counters_read, so no count of a running thread is lost.
+//
+void map_counters_reset() {
+	pthread_mutex_lock(&counters_lock);
+	counters_sum(counters_base);
+	pthread_mutex_unlock(&counters_lock);
+}
@@ -0,0 +1,32 @@
+#ifndef __A1_COUNTERS_H__
+#define __A1_COUNTERS_H__
+
+#include <inttypes.h>
+
+//
+//	Counters of the operations of all maps, only counted if the map is compiled with MAP_COUNTERS. Every thread
+//	counts into its own cache line, so the counting threads never share a line and no atomic instructions are
+//	needed. map_counters_read adds up the lines of all threads, including the threads that ended already. Without
+//	MAP_COUNTERS the counting compiles to nothing and all counters stay zero.
+//
+
+// the counters
+#define MAP_COUNTER_HIT 0			// map_get found the key
+#define MAP_COUNTER_MISS 1			// map_get did not find the key
+#define MAP_COUNTER_INSERT 2		// map_put added a key
+#define MAP_COUNTER_OVERWRITE 3		// the value of an existing key was replaced
+#define MAP_COUNTER_REUSE 4			// a key was placed into the slot of a deleted key with the same hash
+#define MAP_COUNTER_REMOVE 5		// map_remove removed a key
+#define MAP_COUNTER_RESIZE 6		// the entries array was rebuilt
+#define MAP_COUNTER_RESIZE_NANOS 7	// the nanoseconds spent rebuilding the entries array
+#define MAP_COUNTER_RESEED 8		// the keys clustered, the map switched to a new hash key
+#define MAP_COUNTER_COUNT 9
+
+// the sum of the counters of all threads
+typedef struct {
+	uint64_t counts[MAP_COUNTER_COUNT];
+} map_counters_t;
+
+void map_counters_read(map_counters_t*);
+void map_counters_reset();
+#endif
@@ -0,0 +1,266 @@
+#include <pthread.h>
+#include <string.h>
+#include "crc32c.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_X86 1
+#elif defined(__aarch64__) && defined(__linux__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define CRC32C_ARM 1
+#endif
+
+// the reversed Castagnoli polynomial
+#define CRC32C_POLYNOMIAL 0x82F63B78
+
+// the words of the second stream of the hash are multiplied by this odd constant, so it is not a linear function of
+// the first stream
+#define CRC32C_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+// the table for the software implementation, one entry per byte value
+static uint32_t crc32c_table[256];
+
+// an implementation of the hash
+typedef uint64_t (*crc32c_hash_t)(const uint64_t*, const unsigned char*, size_t);
+
+// the implementations selected at the first call, the hash is set last
+static uint32_t (*crc32c_update)(uint32_t, const unsigned char*, size_t);
+static crc32c_hash_t crc32c_hasher = NULL;
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+
+//
+//	Updates the (not inverted) checksum with the provided bytes, one byte per table lookup.
+//
+static uint32_t crc32c_software(uint32_t crc, const unsigned char* p, size_t length) {
+	while (length-- > 0) crc = crc32c_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+//
+//	Loads up to 8 bytes little endian, the missing bytes are zero.
+//
+static inline uint64_t crc32c_load(const unsigned char* p, const size_t length) {
+	uint64_t v = 0;
+	memcpy(&v, p, length);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v) >> (64 - 8 * length);
+#endif
+	return v;
+}
+
+//
+//	Combines the two streams of the hash and the length into 64 bits whose low bits depend on all of them.
+//
+static inline uint64_t crc32c_finish(const uint32_t a, const uint32_t b, const size_t length) {
+	uint64_t h = (((uint64_t)a << 32) | b) + length;
+	h ^= h >> 29;
+	h *= 0xBF58476D1CE4E5B9ULL;
+	return h ^ (h >> 32);
+}
+
+//
+//	Updates the (not inverted) checksum with 8 bytes, as the CPU instructions do.
+//
+static inline uint32_t crc32c_word(uint32_t crc, uint64_t v) {
+	int i;
+	for (i = 0; i < 8; i++) {
+		crc = crc32c_table[(crc ^ v) & 0xFF] ^ (crc >> 8);
+		v >>= 8;
+	}
+	return crc;
+}
+
+//
+//	Hashes the provided bytes with two CRC32C streams, a byte per table lookup. The result is the same as the one of
+//	the CPU instructions.
+//
+static uint64_t crc32c_hash_software(const uint64_t* seed, const unsigned char* p, const size_t length) {
+	uint32_t a = (uint32_t)seed[0];
+	uint32_t b = (uint32_t)seed[1];
+	size_t n = length;
+	for (; n >= 8; n -= 8, p += 8) {
+		const uint64_t v = crc32c_load(p, 8);
+		a = crc32c_word(a, v);
+		b = crc32c_word(b, v * CRC32C_MULTIPLIER);
+	}
+	if (n > 0) {
+		const uint64_t v = crc32c_load(p, n);
+		a = crc32c_word(a, v);
+		b = crc32c_word(b, v * CRC32C_MULTIPLIER);
+	}
+	return crc32c_finish(a, b, length);
+}
+
+#ifdef CRC32C_X86
+//
+//	Updates the (not inverted) checksum with the provided bytes, 8 bytes per instruction.
+//
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hardware(uint32_t crc, const unsigned char* p, size_t length) {
+#ifdef __x86_64__
+	uint64_t crc64 = crc;
+	while (length >= 8) {
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		crc64 = _mm_crc32_u64(crc64, v);
+		p += 8;
+		length -= 8;
+	}
+	crc = (uint32_t)crc64;
+#endif
+	while (length >= 4) {
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		crc = _mm_crc32_u32(crc, v);
+		p += 4;
+		length -= 4;
+	}
+	while (length-- > 0) crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+}
+
+#ifdef __x86_64__
+//
+//	Hashes the provided bytes with two CRC32C streams, the instructions of both streams run in parallel.
+//
+__attribute__((target("sse4.2")))
+static uint64_t crc32c_hash_hardware(const uint64_t* seed, const unsigned char* p, const size_t length) {
+	uint64_t a = (uint32_t)seed[0];
+	uint64_t b = (uint32_t)seed[1];
+	size_t n = length;
+	for (; n >= 8; n -= 8, p += 8) {
+		const uint64_t v = crc32c_load(p, 8);
+		a = _mm_crc32_u64(a, v);
+		b = _mm_crc32_u64(b, v * CRC32C_MULTIPLIER);
+	}
+	if (n > 0) {
+		const uint64_t v = crc32c_load(p, n);
+		a = _mm_crc32_u64(a, v);
+		b = _mm_crc32_u64(b, v * CRC32C_MULTIPLIER);
+	}
+	return crc32c_finish((uint32_t)a, (uint32_t)b, length);
+}
+#endif
+#endif
+
+#ifdef CRC32C_ARM
+//
+//	Updates the (not inverted) checksum with the provided bytes, 8 bytes per instruction.
+//
+__attribute__((target("+crc")))
+static uint32_t crc32c_hardware(uint32_t crc, const unsigned char* p, size_t length) {
+	while (length >= 8) {
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		crc = __crc32cd(crc, v);
+		p += 8;
+		length -= 8;
+	}
+	while (length-- > 0) crc = __crc32cb(crc, *p++);
+	return crc;
+}
+
+//
+//	Hashes the provided bytes with two CRC32C streams, the instructions of both streams run in parallel.
+//
+__attribute__((target("+crc")))
+static uint64_t crc32c_hash_hardware(const uint64_t* seed, const unsigned char* p, const size_t length) {
+	uint32_t a = (uint32_t)seed[0];
+	uint32_t b = (uint32_t)seed[1];
+	size_t n = length;
+	for (; n >= 8; n -= 8, p += 8) {
+		const uint64_t v = crc32c_load(p, 8);
+		a = __crc32cd(a, v);
+		b = __crc32cd(b, v * CRC32C_MULTIPLIER);
+	}
+	if (n > 0) {
+		const uint64_t v = crc32c_load(p, n);
+		a = __crc32cd(a, v);
+		b = __crc32cd(b, v * CRC32C_MULTIPLIER);
+	}
+	return crc32c_finish(a, b, length);
+}
+#endif
+
+//
+//	Builds the table and selects the implementation, called once.
+//
+static void crc32c_init() {
+	unsigned int i;
+	for (i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		int bit;
+		for (bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0 - (crc & 1)));
+		crc32c_table[i] = crc;
+	}
+
+	crc32c_update = crc32c_software;
+	crc32c_hash_t hasher = crc32c_hash_software;
+#if defined(CRC32C_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2")) {
+		crc32c_update = crc32c_hardware;
+#ifdef __x86_64__
+		hasher = crc32c_hash_hardware;
+#endif
+	}
+#elif defined(CRC32C_ARM)
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+		crc32c_update = crc32c_hardware;
+		hasher = crc32c_hash_hardware;
+	}
+#endif
+	__atomic_store_n(&crc32c_hasher, hasher, __ATOMIC_RELEASE);
+}
+
+//
+//	Calculates the CRC32C checksum of the provided bytes.
+//
+//	@param crc
+//		the checksum of the previous bytes or 0.
+//	@param data
+//		the bytes.
+//	@param length
+//		the amount of bytes.
+//	@return
+//		the checksum including the provided bytes.
+//
+uint32_t map_crc32c(const uint32_t crc, const void* data, const size_t length) {
+	pthread_once(&crc32c_once, crc32c_init);
+	return ~crc32c_update(~crc, data, length);
+}
+
+//
+//	Returns 1 if the checksums are calculated using CPU instructions, otherwise 0.
+//
+int map_crc32c_hardware() {
+	pthread_once(&crc32c_once, crc32c_init);
+	return crc32c_update != crc32c_software;
+}
+
+//
+//	Calculates a 64-bit hash of the provided bytes from two CRC32C streams started with the two words of the seed.
+//	The second stream gets every word multiplied, the streams and the length are mixed at the end. Every machine
+//	calculates the same hash, with or without the CPU instructions. The hash is fast, but like every CRC it is
+//	linear, so keys colliding for every seed can be constructed: it must not hash keys chosen by an attacker.
+//
+//	@param seed
+//		the two 64-bit words of the seed, only their low 32 bits are used.
+//	@param data
+//		the bytes to hash.
+//	@param length
+//		the amount of bytes.
+//	@return
+//		the 64-bit hash.
+//
+uint64_t map_crc32c_hash(const uint64_t* seed, const void* data, const size_t length) {
+	crc32c_hash_t hasher = __atomic_load_n(&crc32c_hasher, __ATOMIC_ACQUIRE);
+	if (hasher == NULL) {
+		pthread_once(&crc32c_once, crc32c_init);
+		hasher = crc32c_hasher;
+	}
+	return hasher(seed, data, length);
+}
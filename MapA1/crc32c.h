@@ -0,0 +1,18 @@
+#ifndef __A1_CRC32C_H__
+#define __A1_CRC32C_H__
+
+#include <stddef.h>
+#include <inttypes.h>
+
+//
+//	CRC32C (Castagnoli) checksums. On x86 with SSE4.2 and on ARMv8 with the CRC extension the CPU instructions are
+//	used, this is detected once at runtime. Otherwise a table driven implementation is used. The checksum of the
+//	previous bytes can be passed in to continue it, the first call gets 0.
+//
+
+uint32_t map_crc32c(uint32_t, const void*, size_t);
+int map_crc32c_hardware();
+
+// the CRC32C based hash of the keys, see map_init_hash
+uint64_t map_crc32c_hash(const uint64_t*, const void*, size_t);
+#endif
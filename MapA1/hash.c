@@ -0,0 +1,104 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include "hash.h"
+
+#define SIP_ROTATE(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIP_ROUND(v0, v1, v2, v3) do { \
+	v0 += v1; v1 = SIP_ROTATE(v1, 13); v1 ^= v0; v0 = SIP_ROTATE(v0, 32); \
+	v2 += v3; v3 = SIP_ROTATE(v3, 16); v3 ^= v2; \
+	v0 += v3; v3 = SIP_ROTATE(v3, 21); v3 ^= v0; \
+	v2 += v1; v1 = SIP_ROTATE(v1, 17); v1 ^= v2; v2 = SIP_ROTATE(v2, 32); \
+} while (0)
+
+
+//
+//	Loads 8 bytes little endian from a possibly unaligned address.
+//
+static inline uint64_t hash_load64(const unsigned char* p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+//
+//	Calculates the SipHash-1-3 of the provided bytes.
+//
+//	@param key
+//		the two 64-bit words of the 128 bit key.
+//	@param data
+//		the bytes to hash.
+//	@param length
+//		the amount of bytes.
+//	@return
+//		the 64-bit hash.
+//
+uint64_t map_siphash(const uint64_t* key, const void* data, const size_t length) {
+	uint64_t v0 = key[0] ^ 0x736F6D6570736575ULL;
+	uint64_t v1 = key[1] ^ 0x646F72616E646F6DULL;
+	uint64_t v2 = key[0] ^ 0x6C7967656E657261ULL;
+	uint64_t v3 = key[1] ^ 0x7465646279746573ULL;
+
+	const unsigned char* p = data;
+	const unsigned char* end = p + (length & ~(size_t)7);
+	for (; p != end; p += 8) {
+		const uint64_t m = hash_load64(p);
+		v3 ^= m;
+		SIP_ROUND(v0, v1, v2, v3);
+		v0 ^= m;
+	}
+
+	// the last word holds the remaining bytes and the length in its highest byte
+	uint64_t last = (uint64_t)length << 56;
+	switch (length & 7) {
+	case 7: last |= (uint64_t)p[6] << 48; // fall through
+	case 6: last |= (uint64_t)p[5] << 40; // fall through
+	case 5: last |= (uint64_t)p[4] << 32; // fall through
+	case 4: last |= (uint64_t)p[3] << 24; // fall through
+	case 3: last |= (uint64_t)p[2] << 16; // fall through
+	case 2: last |= (uint64_t)p[1] << 8; // fall through
+	case 1: last |= (uint64_t)p[0]; break;
+	default: break;
+	}
+	v3 ^= last;
+	SIP_ROUND(v0, v1, v2, v3);
+	v0 ^= last;
+
+	v2 ^= 0xFF;
+	SIP_ROUND(v0, v1, v2, v3);
+	SIP_ROUND(v0, v1, v2, v3);
+	SIP_ROUND(v0, v1, v2, v3);
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+//
+//	Fills a 128 bit key with random bytes of the operating system. If there are none (no getrandom and no
+//	/dev/urandom, for example in a chroot), the time and addresses are mixed, that is still different for every map
+//	and every run.
+//
+//	@param seed
+//		the two 64-bit words to fill.
+//
+void map_hash_seed(uint64_t* seed) {
+	if (getrandom(seed, sizeof(uint64_t) * 2, 0) == (ssize_t)(sizeof(uint64_t) * 2)) return;
+
+	FILE* random = fopen("/dev/urandom", "rb");
+	if (random != NULL) {
+		const size_t read = fread(seed, sizeof(uint64_t) * 2, 1, random);
+		fclose(random);
+		if (read == 1) return;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	const uint64_t mix[2] = { (uint64_t)now.tv_sec ^ (uintptr_t)seed, (uint64_t)now.tv_nsec ^ ((uint64_t)getpid() << 32) };
+	seed[0] = map_siphash(mix, &now, sizeof(now));
+	seed[1] = map_siphash(mix, seed, sizeof(uint64_t));
+}
@@ -0,0 +1,16 @@
+#ifndef __A1_HASH_H__
+#define __A1_HASH_H__
+
+#include <stddef.h>
+#include <inttypes.h>
+
+//
+//	Keyed hashing of the keys. FNV1 (see map.h) is fast, but anybody can compute keys that collide in a map and
+//	make every operation scan the whole map. SipHash-1-3 is a keyed hash: without the 128 bit key (the seed of the
+//	map) the hashes of the keys cannot be predicted, so such keys cannot be computed either. This is the variant
+//	with one compression and three finalization rounds, that hash tables commonly use instead of SipHash-2-4.
+//
+
+uint64_t map_siphash(const uint64_t*, const void*, size_t);
+void map_hash_seed(uint64_t*);
+#endif
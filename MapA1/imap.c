@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "imap.h"
+#include "map_internal.h"
+
+// note: must be 2^n, default is 8
+#define IMAP_MIN_EMPTY_SLOTS (1 << 3)
+
+#define IMAP_MAGIC 0x1234567890123458
+
+// the mixed keys marking an empty and a deleted slot
+#define IMAP_EMPTY 0
+#define IMAP_DELETED 1
+
+
+//
+//	The integer map probes like the map, but its slots start at the mixed key (map_mix) instead of a hash. Because
+//	the mixing is a bijection, the mixed key is compared instead of the key and the slot holds nothing else, so
+//	consecutive keys (the common case for IDs) spread over all slots without storing a hash. A removed key leaves
+//	IMAP_DELETED behind, the slot is taken over by the next key inserted through it. A rebuild does not mix the keys
+//	again. The mixing maps 0 to 0, so the key 0 and the one key mixed into 1 are kept in the map struct.
+//
+
+
+//
+//	Searches for the provided mixed key and returns its slot or -1 if the key is not in the map. If the key is not
+//	found, the slot where the key can be placed is stored in free, this is either the first deleted slot or the
+//	empty slot that ended the search.
+//
+//	@param self
+//		the integer map to search in.
+//	@param mixed
+//		the mixed key, not IMAP_EMPTY or IMAP_DELETED.
+//	@param free
+//		receives the slot for the key, may be NULL.
+//	@param probe
+//		receives the amount of slots compared, may be NULL. A missing key is searched up to the empty slot, so this
+//		counts the slots behind a deleted slot that the key takes over as well.
+//	@return
+//		the slot of the key or -1 if this key is not in the map.
+//
+static int imap_indexOf(imap_t* self, const uint64_t mixed, unsigned int* free, unsigned int* probe) {
+	const unsigned int mask = self->capacity - 1;
+	const imap_entry_t* entries = self->entries;
+	unsigned int i = mixed & mask;
+	unsigned int l = self->capacity;
+	int reuse = -1;
+
+	while (l-- > 0) {
+		const uint64_t key = entries[i].key;
+		if (key == mixed) return i;
+
+		// as soon as we hit an empty slot we can be sure that this key is not in the map
+		if (key == IMAP_EMPTY) {
+			if (free != NULL) *free = reuse >= 0 ? (unsigned int)reuse : i;
+			if (probe != NULL) *probe = self->capacity - l;
+			return -1;
+		}
+
+		// remember the first deleted slot, so the key can take it over
+		if (key == IMAP_DELETED && reuse < 0) reuse = i;
+
+		i = (i+1) & mask;
+	}
+
+	// every slot is allocated, a deleted one can still be taken
+	if (free != NULL) *free = (unsigned int)reuse;
+	if (probe != NULL) *probe = self->capacity;
+	return -1;
+}
+
+//
+//	Rebuilds the integer map with space for at least the provided amount of keys. The deleted slots are dropped.
+//
+//	@param self
+//		the pointer to the integer map struct.
+//	@param minNewSize
+//		the minimal amount of slots the map must have afterwards.
+//	@return
+//		OK or SYS_ERROR.
+//
+static int imap_rebuild(imap_t* self, const unsigned int minNewSize) {
+	unsigned int newLength = IMAP_MIN_EMPTY_SLOTS;
+	while (newLength < minNewSize) newLength <<= 1;
+	imap_entry_t* newEntries = calloc(newLength, sizeof(imap_entry_t));
+	if (newEntries == NULL) return SYS_ERROR;
+
+	const unsigned int mask = newLength - 1;
+	unsigned int allocated = 0;
+	unsigned int j;
+	for (j = 0; j < self->capacity; j++) {
+		const imap_entry_t* entry = self->entries + j;
+		if (entry->key == IMAP_EMPTY || entry->key == IMAP_DELETED) continue;
+
+		// no key can exist twice so we only need to find an empty slot
+		unsigned int i = entry->key & mask;
+		while (newEntries[i].key != IMAP_EMPTY) i = (i+1) & mask;
+		newEntries[i] = *entry;
+		allocated++;
+	}
+
+	free(self->entries);
+	self->entries = newEntries;
+	self->capacity = newLength;
+	self->allocated = allocated;
+	return OK;
+}
+
+//
+//	Initializes the given integer map and allocates memory to the map.
+//
+//	@param self
+//		the integer map to be initialized.
+//
+void imap_init(imap_t* self) {
+	if (self == NULL) return;
+	self->magic = IMAP_MAGIC;
+	self->capacity = IMAP_MIN_EMPTY_SLOTS;
+	self->size = 0;
+	self->allocated = 0;
+	self->special = 0;
+	self->values[0] = NULL;
+	self->values[1] = NULL;
+	self->entries = calloc(self->capacity, sizeof(imap_entry_t));
+}
+
+//
+//	Assigns the provided value to the provided key and returns OK if this was successfull or KEY_EXISTS if the key
+//	exists already.
+//
+//	@param self
+//		the integer map in which to put the key-value pair.
+//	@param key
+//		the key.
+//	@param value
+//		the value.
+//	@return
+//		OK if the key-value pair was inserted, KEY_EXISTS is the key is already set or SYS_ERROR if the map could
+//		not grow.
+//
+int imap_put(imap_t* self, const uint64_t key, void* value) {
+	if (self == NULL) return NULL_POINTER;
+	if (self->magic != IMAP_MAGIC) return NOT_INITIALIZED;
+
+	const uint64_t mixed = map_mix(key);
+	if (mixed <= IMAP_DELETED) {
+		if (self->special & (1u << mixed)) return KEY_EXISTS;
+		self->special |= 1u << mixed;
+		self->values[mixed] = value;
+		self->size++;
+		return OK;
+	}
+
+	unsigned int slot = 0;
+	unsigned int probe = 0;
+	if (imap_indexOf(self, mixed, &slot, &probe) >= 0) return KEY_EXISTS;
+
+	// if there is no empty slot left, rebuild the map and search the slot again
+	if (self->allocated >= self->capacity) {
+		if (imap_rebuild(self, self->size + IMAP_MIN_EMPTY_SLOTS) != OK) return SYS_ERROR;
+		imap_indexOf(self, mixed, &slot, &probe);
+	}
+
+	imap_entry_t* entry = self->entries + slot;
+	if (entry->key == IMAP_EMPTY) self->allocated++;
+	entry->key = mixed;
+	entry->value = value;
+	self->size++;
+
+	// the mixing cannot be replaced like the hash of the map, so only a full map grows to shorten a long probe
+	const unsigned int slots = map_probe_bound(probe, self->size, self->allocated, self->capacity, IMAP_MIN_EMPTY_SLOTS);
+	if (slots > 0) imap_rebuild(self, slots);
+	return OK;
+}
+
+//
+//	Looks up for the provided key and returns its value.
+//
+//	@param self
+//		the integer map into which to look for the key.
+//	@param key
+//		the key to search.
+//	@return
+//		the value (which might be null either!) of the key or null is no such key exists in the map.
+//
+void* imap_get(imap_t* self, const uint64_t key) {
+	if (self == NULL || self->magic != IMAP_MAGIC) return NULL;
+
+	const uint64_t mixed = map_mix(key);
+	if (mixed <= IMAP_DELETED) return self->special & (1u << mixed) ? self->values[mixed] : NULL;
+	const int i = imap_indexOf(self, mixed, NULL, NULL);
+	return i < 0 ? NULL : self->entries[i].value;
+}
+
+//
+//	Removes the key-value pair with the given key from the integer map.
+//
+//	@param self
+//		the integer map from which to remove the key-value pair.
+//	@param key
+//		the key of the entity to be removed.
+//	@return
+//		OK if the key-value pair was removed successfully or NO_KEY_EXISTS if the provided map doesn't contain such
+//		a key.
+//
+int imap_remove(imap_t* self, const uint64_t key) {
+	if (self == NULL) return NULL_POINTER;
+	if (self->magic != IMAP_MAGIC) return NOT_INITIALIZED;
+
+	const uint64_t mixed = map_mix(key);
+	if (mixed <= IMAP_DELETED) {
+		if (!(self->special & (1u << mixed))) return NO_KEY_EXISTS;
+		self->special &= ~(1u << mixed);
+		self->values[mixed] = NULL;
+		self->size--;
+		return OK;
+	}
+
+	const int i = imap_indexOf(self, mixed, NULL, NULL);
+	if (i < 0) return NO_KEY_EXISTS;
+	self->entries[i].key = IMAP_DELETED;
+	self->entries[i].value = NULL;
+	self->size--;
+	return OK;
+}
+
+//
+//	Returns the amount of key-value pairs stored in the provided integer map.
+//
+//	@param self
+//		the integer map for which to return the size.
+//	@return
+//		the amount of key-value pairs stored in the provided map.
+//
+int imap_size(imap_t* self) {
+	if (self == NULL || self->magic != IMAP_MAGIC) return 0;
+	return self->size;
+}
+
+//
+//	Frees the memory allocated for the integer map.
+//
+//	@param self
+//		the integer map to destroy and for which to release memory.
+//
+void imap_destroy(imap_t* self) {
+	if (self == NULL) return;
+	if (self->magic != IMAP_MAGIC) return;
+
+	free(self->entries);
+	self->entries = NULL;
+	self->magic = 0;
+}
@@ -0,0 +1,48 @@
+#ifndef __A1_IMAP_H__
+#define __A1_IMAP_H__
+
+#include "map.h"
+
+//
+//	The integer map is a variant of the map for uint64 keys and pointer values. A slot holds the key mixed into a
+//	hash and the value, 16 bytes instead of the 24 bytes of a map_entry_t plus the key string, and a lookup compares
+//	integers instead of strings. The mixing is a bijection, so the mixed key identifies the key and no key has to be
+//	stored besides it.
+//
+
+// a slot: the mixed key (IMAP_EMPTY and IMAP_DELETED mark free slots) and the value
+typedef struct {
+	uint64_t key;
+	void* value;
+} imap_entry_t;
+
+// the root integer map struct
+typedef struct {
+	// used to detect that the map was initialized
+	int64_t magic;
+
+	// a pointer to the entries (basically an array of slots)
+	imap_entry_t* entries;
+
+	// the amount of valid entries in the map, including the special keys
+	unsigned int size;
+
+	// the amount of slots that are not empty (valid and deleted ones)
+	unsigned int allocated;
+
+	// the total amount of entries (slots), always 2^n
+	unsigned int capacity;
+
+	// the two keys that are mixed into IMAP_EMPTY and IMAP_DELETED cannot use a slot: bit i is set if the key
+	// mixed into i is in the map and values[i] is its value
+	unsigned int special;
+	void* values[2];
+} imap_t;
+
+void imap_init(imap_t*);
+int imap_put(imap_t*, uint64_t, void*);
+void* imap_get(imap_t*, uint64_t);
+int imap_remove(imap_t*, uint64_t);
+int imap_size(imap_t*);
+void imap_destroy(imap_t*);
+#endif
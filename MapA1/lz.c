@@ -0,0 +1,213 @@
+#include <stdint.h>
+#include <string.h>
+#include "map.h"
+#include "lz.h"
+
+// a match needs at least 4 bytes and the offset is stored in 16 bits
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 0xFFFF
+
+// the last 5 bytes are always literals and the last match must start 12 bytes before the end
+#define LZ_LAST_LITERALS 5
+#define LZ_MATCH_LIMIT 12
+
+// the size of the hash table, 2^12 positions
+#define LZ_HASH_BITS 12
+
+
+//
+//	The block is a sequence of (token, literals, offset, match) tuples. The high 4 bits of the token are the amount
+//	of literals, the low 4 bits the length of the match minus 4. If one of them is 15, more bytes follow and are
+//	added until a byte is not 255. The last sequence only consists of literals.
+//
+
+
+static inline uint32_t lz_read32(const unsigned char* p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline unsigned int lz_hash(const uint32_t sequence) {
+	return (sequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+//
+//	Writes a length that does not fit into the token, as bytes of 255 followed by the rest.
+//
+//	@param op
+//		where to write the length.
+//	@param length
+//		the length minus 15.
+//	@return
+//		the position after the length.
+//
+static inline unsigned char* lz_length(unsigned char* op, size_t length) {
+	while (length >= 255) {
+		*op++ = 255;
+		length -= 255;
+	}
+	*op++ = (unsigned char)length;
+	return op;
+}
+
+//
+//	Writes a sequence of literals optionally followed by a match.
+//
+//	@param op
+//		where to write the sequence.
+//	@param end
+//		the end of the output buffer.
+//	@param literals
+//		the literals.
+//	@param count
+//		the amount of literals.
+//	@param offset
+//		the distance back to the match, 0 for the last sequence.
+//	@param match
+//		the length of the match.
+//	@return
+//		the position after the sequence or NULL if it does not fit into the output buffer.
+//
+static unsigned char* lz_sequence(unsigned char* op, const unsigned char* end, const unsigned char* literals, const size_t count, const unsigned int offset, const size_t match) {
+	if ((size_t)(end - op) < 1 + count + count / 255 + 1 + 2 + match / 255 + 1) return NULL;
+
+	unsigned char* token = op++;
+	*token = (unsigned char)((count < 15 ? count : 15) << 4);
+	if (count >= 15) op = lz_length(op, count - 15);
+	memcpy(op, literals, count);
+	op += count;
+	if (offset == 0) return op;
+
+	*op++ = (unsigned char)offset;
+	*op++ = (unsigned char)(offset >> 8);
+	const size_t length = match - LZ_MIN_MATCH;
+	*token |= (unsigned char)(length < 15 ? length : 15);
+	if (length >= 15) op = lz_length(op, length - 15);
+	return op;
+}
+
+//
+//	Compresses the provided bytes into one block.
+//
+//	@param source
+//		the bytes to compress.
+//	@param length
+//		the amount of bytes to compress.
+//	@param target
+//		the buffer for the compressed block.
+//	@param capacity
+//		the size of the buffer, with MAP_LZ_BOUND(length) the block always fits.
+//	@return
+//		the size of the block or 0 if the block did not fit into the buffer.
+//
+size_t map_lz_compress(const unsigned char* source, const size_t length, unsigned char* target, const size_t capacity) {
+	uint32_t table[1 << LZ_HASH_BITS];
+	memset(table, 0, sizeof(table));
+
+	const unsigned char* ip = source;
+	const unsigned char* anchor = source;
+	const unsigned char* end = source + length;
+	unsigned char* op = target;
+	const unsigned char* oend = target + capacity;
+
+	if (length > LZ_MATCH_LIMIT) {
+		const unsigned char* limit = end - LZ_MATCH_LIMIT;
+		const unsigned char* matchLimit = end - LZ_LAST_LITERALS;
+		unsigned int misses = 0;
+		while (ip < limit) {
+			const uint32_t sequence = lz_read32(ip);
+			const unsigned int h = lz_hash(sequence);
+			const unsigned char* ref = source + table[h];
+			table[h] = (uint32_t)(ip - source);
+
+			if (ref >= ip || ip - ref > LZ_MAX_OFFSET || lz_read32(ref) != sequence) {
+				// skip faster through data that does not compress
+				ip += 1 + (misses++ >> 6);
+				continue;
+			}
+			misses = 0;
+
+			size_t match = LZ_MIN_MATCH;
+			while (ip + match < matchLimit && ref[match] == ip[match]) match++;
+
+			op = lz_sequence(op, oend, anchor, ip - anchor, (unsigned int)(ip - ref), match);
+			if (op == NULL) return 0;
+			ip += match;
+			anchor = ip;
+		}
+	}
+
+	op = lz_sequence(op, oend, anchor, end - anchor, 0, 0);
+	return op == NULL ? 0 : (size_t)(op - target);
+}
+
+//
+//	Decompresses one block. The block is checked while decompressing, so a corrupted block never writes outside of
+//	the target buffer.
+//
+//	@param source
+//		the compressed block.
+//	@param length
+//		the size of the compressed block.
+//	@param target
+//		the buffer for the bytes.
+//	@param size
+//		the amount of bytes the block decompresses to.
+//	@return
+//		OK or INVALID_FORMAT if the block is corrupted.
+//
+int map_lz_decompress(const unsigned char* source, const size_t length, unsigned char* target, const size_t size) {
+	const unsigned char* ip = source;
+	const unsigned char* end = source + length;
+	unsigned char* op = target;
+	unsigned char* oend = target + size;
+
+	while (ip < end) {
+		const unsigned int token = *ip++;
+
+		size_t count = token >> 4;
+		if (count == 15) {
+			unsigned int b;
+			do {
+				if (ip >= end) return INVALID_FORMAT;
+				b = *ip++;
+				count += b;
+			} while (b == 255);
+		}
+		if (count > (size_t)(end - ip) || count > (size_t)(oend - op)) return INVALID_FORMAT;
+		memcpy(op, ip, count);
+		ip += count;
+		op += count;
+
+		// the last sequence has no match
+		if (ip == end) break;
+
+		if (end - ip < 2) return INVALID_FORMAT;
+		const size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - target)) return INVALID_FORMAT;
+
+		size_t match = token & 15;
+		if (match == 15) {
+			unsigned int b;
+			do {
+				if (ip >= end) return INVALID_FORMAT;
+				b = *ip++;
+				match += b;
+			} while (b == 255);
+		}
+		match += LZ_MIN_MATCH;
+		if (match > (size_t)(oend - op)) return INVALID_FORMAT;
+
+		// an overlapping match repeats the last bytes and must be copied byte by byte
+		const unsigned char* ref = op - offset;
+		if (offset >= match) {
+			memcpy(op, ref, match);
+			op += match;
+		} else {
+			while (match-- > 0) *op++ = *ref++;
+		}
+	}
+	return op == oend ? OK : INVALID_FORMAT;
+}
@@ -0,0 +1,17 @@
+#ifndef __A1_LZ_H__
+#define __A1_LZ_H__
+
+#include <stddef.h>
+
+//
+//	A small LZ77 compressor producing the LZ4 block format. It favours speed over ratio: matches are only searched
+//	using a hash table of the last position of every 4 byte sequence, so compressing and decompressing run at
+//	memory speed. Every call compresses an independent block, no state is shared between blocks.
+//
+
+// the maximal size of the compressed form of the provided amount of bytes
+#define MAP_LZ_BOUND(length) ((length) + (length) / 255 + 16)
+
+size_t map_lz_compress(const unsigned char*, size_t, unsigned char*, size_t);
+int map_lz_decompress(const unsigned char*, size_t, unsigned char*, size_t);
+#endif
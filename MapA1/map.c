@@ -3,11 +3,50 @@
 #include <string.h>
 #include <inttypes.h>
 #include "map.h"
+#include "map_internal.h"
+#include "snapshot.h"
+#include "wal.h"
 
 // note: must be 2^n, default is 8
 #define MIN_EMPTY_SLOTS (1 << 3)
 
-#define MAGIC 0x1234567890123456
+// a map with external hashes grows to shorten the probes as long as it stays at least 1/MAP_EXTERNAL_LOAD full
+#define MAP_EXTERNAL_LOAD 16
+
+// the size of the memory blocks for the keys and values owned by the map
+#define MAP_BLOCK_SIZE (64 << 10)
+
+// the filter has a block of 8 words (one cache line) per MAP_FILTER_SLOTS slots, a key sets one bit in every word of
+// its block, that are at least 16 bits per key
+#define MAP_FILTER_WORDS 8
+#define MAP_FILTER_SLOTS 32
+
+// the odd multipliers selecting the bit of a key in each word of its block
+static const uint32_t map_filter_salts[MAP_FILTER_WORDS] = {
+	0x47B6137BU, 0x44974D91U, 0x8824AD5BU, 0xA2B7289DU, 0x705495C7U, 0x2DF1424BU, 0x9EFC4947U, 0x5C6BFB31U
+};
+
+// a memory block for the keys and values owned by the map, the memory directly follows this header
+typedef struct map_block_s {
+	struct map_block_s* next;
+	size_t size;
+	size_t used;
+} map_block_t;
+
+// the blocks of a map, shared with the snapshots that write entries pointing into them, the last one releases them
+typedef struct map_strings_s {
+	map_block_t* blocks;
+	unsigned int references;
+} map_strings_t;
+
+#ifdef MAP_TRACE
+// the hook receiving the events of all maps, NULL if there is none
+map_trace_t map_tracer = NULL;
+#endif
+
+static int map_insert(map_t*, const char*, const char*, const int64_t);
+static const char* map_lookup(map_t*, const char*, const int64_t);
+static int map_delete(map_t*, const char*, const int64_t);
 
 
 //
@@ -21,6 +60,14 @@
 //	As soon as the allocation reaches the size it will optimize the map, so it will resize the map and re-index all
 //	entities (without re-calculating the hashes).
 //
+//	An insert that has to compare many slots (see MAP_PROBE_FACTOR) bounds the probes: a map that is more than three
+//	quarters full grows, otherwise the keys cluster and the map switches to a new SipHash key and re-calculates all
+//	hashes. A map with external hashes grows instead, up to a bound (see map_bound).
+//
+//	A map can keep a blocked Bloom filter of its hashes (see map_filter). A lookup of a missing key then reads one
+//	cache line of the filter instead of walking the probe chain up to an empty slot. The bits of removed keys stay
+//	set until the map is rebuilt, which builds the filter again from the remaining keys, like the deleted slots.
+//
 //	This is very space efficient and on modern CPUs it is very effective because memory is only accessed linar and
 //	there you can expect no L1 cache miss. However, the hash-map gets slow if it grows too big and it is sub-optimal
 //	if being full.
@@ -29,27 +76,70 @@
 
 
 //
-//	This function calculates a modified FNV1 hash value. Modified in the way that it guarantees that the high bit is
-//	always set, therefore the hash is always negative. This means as well it may never be zero, what is what we need
-//	later on.
+//	Sets the bits of a hash in the filter. The high half of the mixed hash selects the block and the low half the
+//	bits, the FNV1 hashes of similar keys have related halves, so they are mixed first.
+//
+static inline void map_filter_add(map_t* self, const int64_t hash) {
+	const uint64_t mixed = map_mix((uint64_t)hash);
+	uint64_t* block = self->filter + ((mixed >> 32) & self->filterMask) * MAP_FILTER_WORDS;
+	const uint32_t low = (uint32_t)mixed;
+	int w;
+	for (w = 0; w < MAP_FILTER_WORDS; w++) block[w] |= 1ULL << ((low * map_filter_salts[w]) >> 26);
+}
+
+//
+//	Checks the bits of a hash in the filter.
 //
-//	@param text
-//		the zero terminated US-ASCII encoded string to hash.
 //	@return
-//		the 64-bit hash code above the provided string.
+//		0 if no key with this hash is in the map, 1 if one may be.
+//
+static inline int map_filter_test(const map_t* self, const int64_t hash) {
+	const uint64_t mixed = map_mix((uint64_t)hash);
+	const uint64_t* block = self->filter + ((mixed >> 32) & self->filterMask) * MAP_FILTER_WORDS;
+	const uint32_t low = (uint32_t)mixed;
+	uint64_t missing = 0;
+	int w;
+	for (w = 0; w < MAP_FILTER_WORDS; w++) missing |= ~block[w] & (1ULL << ((low * map_filter_salts[w]) >> 26));
+	return missing == 0;
+}
+
 //
-inline int64_t fnv1_hash( const char* text ) {
-	int64_t hash = 0xCBF29CE484222325L;
-	int i = 0;
-	char c = *(text + i++);
-	while (c != 0) {
-		hash ^= c & 0xFF;
-		hash *= 1099511628211L;
-		c = *(text + i++);
-	};
-	return hash | 0x8000000000000000L;
+//	This function is internally used to replace the filter by an empty one sized for the capacity of the map. If
+//	there is no memory for it, the map has no filter afterwards.
+//
+//	@param self
+//		the pointer to the map struct.
+//	@return
+//		OK or SYS_ERROR.
+//
+static int map_filter_reset(map_t* self) {
+	const unsigned int blocks = self->capacity > MAP_FILTER_SLOTS ? self->capacity / MAP_FILTER_SLOTS : 1;
+	const size_t bytes = sizeof(uint64_t) * MAP_FILTER_WORDS * blocks;
+	free(self->filter);
+	self->filter = aligned_alloc(MAP_CACHE_LINE, bytes);
+	self->filterMask = blocks - 1;
+	if (self->filter == NULL) return SYS_ERROR;
+	memset(self->filter, 0, bytes);
+	return OK;
 }
 
+//
+//	This function is internally used to build the filter from the keys of the map, after the slots were filled
+//	without map_set (for example by the threads loading a snapshot).
+//
+//	@param self
+//		the pointer to the map struct.
+//	@return
+//		OK or SYS_ERROR, then the map has no filter anymore.
+//
+int map_filter_fill(map_t* self) {
+	if (map_filter_reset(self) != OK) return SYS_ERROR;
+	unsigned int i;
+	for (i = 0; i < self->capacity; i++) {
+		if (self->entries[i].key != NULL) map_filter_add(self, self->entries[i].hash);
+	}
+	return OK;
+}
 
 //
 //	This function is internally used to place a key-value pair into the map. It returns OK if that succeeded,
@@ -63,13 +153,13 @@ inline int64_t fnv1_hash( const char* text ) {
 //	@param value
 //		pointer to the zero terminated value string.
 //	@param hash
-//		the modified FNV1 hash above the key.
+//		the hash of the key, see map_hash.
 //	@param override
 //		if zero, then an existing key is not replaced, otherwise the value of an existing key is replaced.
 //	@return
 //		OK, KEY_EXISTS or REQUIRES_OPTIMIZATION.
 //
-inline int map_set(map_t* self, const char* key, const char* val, const int64_t hash, const int override ) {
+int map_set(map_t* self, const char* key, const char* val, const int64_t hash, const int override ) {
 	// the length of the items array and a bit-mask to mask the length
 	const unsigned int length = self->capacity;
 	const unsigned int mask = length - 1;
@@ -85,12 +175,16 @@ inline int map_set(map_t* self, const char* key, const char* val, const int64_t
 
 		// if the spot is free
 		if (entry->hash==0) {
+			if (self->snapshot != NULL) map_snapshot_preserve(self->snapshot, i);
+
 			// add the key, value and hash here
 			entry->key = key;
 			entry->value = val;
 			entry->hash = hash;
 			self->allocated++;
 			self->size++;
+			self->probe = length - l;
+			if (self->filter != NULL) map_filter_add(self, hash);
 			return OK;
 		}
 
@@ -98,11 +192,16 @@ inline int map_set(map_t* self, const char* key, const char* val, const int64_t
 		if (entry->hash == hash) {
 			// if the entry was deleted and is therefore free
 			if (entry->key==NULL) {
+				if (self->snapshot != NULL) map_snapshot_preserve(self->snapshot, i);
+
 				// reset it
 				entry->key = key;
 				entry->value = val;
 				// allocation stays the same, but the size increases
 				self->size++;
+				self->probe = length - l;
+				if (self->filter != NULL) map_filter_add(self, hash);
+				MAP_COUNT(MAP_COUNTER_REUSE, 1);
 				return OK;
 			}
 
@@ -110,9 +209,11 @@ inline int map_set(map_t* self, const char* key, const char* val, const int64_t
 			if (entry->key==key || strcmp(entry->key, key)==0) {
 				// if we should not override it
 				if (override==0) return KEY_EXISTS;
+				if (self->snapshot != NULL) map_snapshot_preserve(self->snapshot, i);
 
 				// replace the value (size and allocation stay unchanged)
 				entry->value = val;
+				MAP_COUNT(MAP_COUNTER_OVERWRITE, 1);
 				return OK;
 			}
 
@@ -126,31 +227,44 @@ inline int map_set(map_t* self, const char* key, const char* val, const int64_t
 
 
 //
-//	This function is internally used to optimize the map. An optimization will ensure that there is at least enough
-//	space for MIN_EMPTY_SLOTS further new key-value pairs. This means it may increase or decrease the size of the map,
-//	dependend at the requirements.
+//	This function is internally used to rebuild the map with at least the provided amount of slots. All entries are
+//	re-added and the deleted ones are dropped. The old entries are not changed, a snapshot being written keeps them.
 //
 //	@param self
 //		the pointer to the map struct.
+//	@param minNewSize
+//		the minimal amount of slots the map must have afterwards.
+//	@param rehash
+//		if zero, the hashes of the entries are kept, otherwise they are calculated with the hash function of the map.
 //	@return
 //		OK or SYS_ERROR.
 //
-int map_optimize(map_t* self) {
+static int map_relocate(map_t* self, const unsigned int minNewSize, const int rehash) {
+#ifdef MAP_COUNTERS
+	const uint64_t started = map_counters_now();
+#endif
+
 	// grab the old entries
 	const unsigned int oldLength = self->capacity;
-	const unsigned int oldSize = self->size;
 	map_entry_t* oldEntries = self->entries;
 
-	// the optimal size must be 2^n, ensuring that there are at least MIN_EMPTY_SLOTS free slots
-	const unsigned int minNewSize = oldSize + MIN_EMPTY_SLOTS;
+	// a snapshot being written keeps the old entries, they do not change anymore from now on
+	struct map_snapshot_s* snapshot = self->snapshot;
+	self->snapshot = NULL;
+
+	// the optimal size must be 2^n
 	unsigned int newLength = MIN_EMPTY_SLOTS;
 	while (newLength < minNewSize) newLength <<= 1;
 	const unsigned int bytes = sizeof(map_entry_t) * newLength;
 	self->capacity = newLength;
 	self->allocated = 0;
 	self->size = 0;
+	self->resizes++;
 	self->entries = memset(malloc(bytes),0,bytes);
 
+	// the filter is built again by map_set, without the removed keys
+	if (self->filter != NULL) map_filter_reset(self);
+
 	// re-add all items using the internal map_set method for performance reasons
 	unsigned int i=0;
 	map_entry_t* oldEntry = oldEntries;
@@ -158,7 +272,8 @@ int map_optimize(map_t* self) {
 		// if this key is not deleted
 		if (oldEntry->key != NULL) {
 			// add it again into the new resized map
-			if (map_set(self, oldEntry->key, oldEntry->value, oldEntry->hash, 0) != 0) {
+			const int64_t hash = rehash ? map_hash(self, oldEntry->key) : oldEntry->hash;
+			if (map_set(self, oldEntry->key, oldEntry->value, hash, 0) != 0) {
 				// this must not happen
 				return SYS_ERROR;
 			}
@@ -167,11 +282,188 @@ int map_optimize(map_t* self) {
 		oldEntry++;
 	}
 
-	// release the old memory
-	free (oldEntries);
+	// release the old memory, unless the snapshot takes it over
+	if (snapshot != NULL) {
+		map_snapshot_detach(snapshot);
+	} else {
+		free (oldEntries);
+	}
+	MAP_TRACE_EVENT(self, MAP_EVENT_REBUILD, NULL);
+	MAP_COUNT(MAP_COUNTER_RESIZE, 1);
+	MAP_COUNT(MAP_COUNTER_RESIZE_NANOS, map_counters_now() - started);
 	return OK;
 }
 
+//
+//	This function is internally used to rebuild the map with at least the provided amount of slots. All entries are
+//	re-added (without re-calculating the hashes) and the deleted ones are dropped.
+//
+//	@param self
+//		the pointer to the map struct.
+//	@param minNewSize
+//		the minimal amount of slots the map must have afterwards.
+//	@return
+//		OK or SYS_ERROR.
+//
+int map_rebuild(map_t* self, const unsigned int minNewSize) {
+	return map_relocate(self, minNewSize, 0);
+}
+
+//
+//	This function is internally used to rebuild the map with the same amount of slots after its hash function or
+//	key changed. All keys are hashed again and the deleted ones are dropped.
+//
+//	@param self
+//		the pointer to the map struct.
+//	@return
+//		OK or SYS_ERROR.
+//
+int map_rehash(map_t* self) {
+	return map_relocate(self, self->capacity, 1);
+}
+
+//
+//	This function is internally used to bound the probes after an insert compared more than MAP_PROBE_FACTOR times
+//	the log2 of the capacity slots. If more than three quarters of the slots have a hash (deleted keys included),
+//	the load explains the long probe and the map is rebuilt half full. Otherwise the keys cluster, because they were
+//	chosen to collide or the hash function does not suit them, then the map switches to SipHash with a new random
+//	key (even if it had a key provided to map_init_hash) and hashes all keys again.
+//
+//	The hashes of a map with external hashes cannot be replaced, it doubles its slots instead. Its hashes are mixed
+//	by a bijection, so different hashes of the caller cluster in the low bits only and more slots spread them. Equal
+//	hashes of the caller cannot be spread by any amount of slots, so the map stops growing once it would be less
+//	than MAP_EXTERNAL_LOAD full and returns REQUIRES_OPTIMIZATION, the probes of those keys stay long.
+//
+//	@param self
+//		the pointer to the map struct.
+//	@return
+//		OK, SYS_ERROR or REQUIRES_OPTIMIZATION if a map with external hashes does not grow further.
+//
+static int map_bound(map_t* self) {
+	const unsigned int slots = map_probe_bound(self->probe, self->size, self->allocated, self->capacity, MIN_EMPTY_SLOTS);
+	if (slots > 0) return map_rebuild(self, slots);
+
+	if (self->hashKind == MAP_HASH_EXTERNAL) {
+		const uint64_t grown = (uint64_t)self->capacity * 2;
+		if (grown > 0x80000000ULL || (uint64_t)self->size * MAP_EXTERNAL_LOAD < grown) return REQUIRES_OPTIMIZATION;
+		return map_rebuild(self, (unsigned int)grown);
+	}
+	self->hashKind = MAP_HASH_SIPHASH;
+	map_hash_seed(self->seed);
+	self->reseeds++;
+	MAP_COUNT(MAP_COUNTER_RESEED, 1);
+	return map_rehash(self);
+}
+
+//
+//	This function is internally used to optimize the map. An optimization will ensure that there is at least enough
+//	space for MIN_EMPTY_SLOTS further new key-value pairs. This means it may increase or decrease the size of the map,
+//	dependend at the requirements.
+//
+//	@param self
+//		the pointer to the map struct.
+//	@return
+//		OK or SYS_ERROR.
+//
+int map_optimize(map_t* self) {
+	return map_rebuild(self, self->size + MIN_EMPTY_SLOTS);
+}
+
+//
+//	This function is internally used to make space for the provided amount of new keys at once, so that they can be
+//	placed using map_set without optimizing the map in between.
+//
+//	@param self
+//		the pointer to the map struct.
+//	@param count
+//		the amount of keys that will be added.
+//	@return
+//		OK or SYS_ERROR.
+//
+int map_reserve(map_t* self, const unsigned int count) {
+	if (self->capacity - self->allocated >= count) return OK;
+	return map_rebuild(self, self->size + count + MIN_EMPTY_SLOTS);
+}
+
+//
+//	This function is internally used to allocate memory for keys and values that are owned by the map, for example
+//	when they are loaded from a stream. The memory is taken from larger blocks and only released by map_destroy, or
+//	by the last snapshot of the map that still writes them.
+//
+//	@param self
+//		the pointer to the map struct.
+//	@param bytes
+//		the amount of bytes needed.
+//	@return
+//		the pointer to the memory or NULL if no memory is available.
+//
+char* map_alloc(map_t* self, const size_t bytes) {
+	map_strings_t* strings = self->strings;
+	if (strings == NULL) {
+		strings = calloc(1, sizeof(map_strings_t));
+		if (strings == NULL) return NULL;
+		strings->references = 1;
+		self->strings = strings;
+	}
+
+	map_block_t* block = strings->blocks;
+	if (block == NULL || block->size - block->used < bytes) {
+		const size_t size = bytes > MAP_BLOCK_SIZE ? bytes : MAP_BLOCK_SIZE;
+		map_block_t* next = malloc(sizeof(map_block_t) + size);
+		if (next == NULL) return NULL;
+		next->size = size;
+		next->used = 0;
+
+		// keep filling the current block if the new one is only for this allocation
+		if (block != NULL && size == bytes) {
+			next->used = size;
+			next->next = block->next;
+			block->next = next;
+			return (char*)(next + 1);
+		}
+		next->next = block;
+		strings->blocks = block = next;
+	}
+
+	char* memory = (char*)(block + 1) + block->used;
+	block->used += bytes;
+	return memory;
+}
+
+//
+//	Takes a reference to the keys and values allocated by the map, so they stay valid after the map is destroyed.
+//	A snapshot takes one while it writes the entries.
+//
+//	@param self
+//		the pointer to the map struct.
+//	@return
+//		the reference for map_strings_release or NULL if the map did not allocate any.
+//
+void* map_strings_retain(map_t* self) {
+	map_strings_t* strings = self->strings;
+	if (strings != NULL) __atomic_add_fetch(&strings->references, 1, __ATOMIC_RELAXED);
+	return strings;
+}
+
+//
+//	Drops a reference to the keys and values allocated by a map, the last one releases them.
+//
+//	@param reference
+//		the reference returned by map_strings_retain or NULL.
+//
+void map_strings_release(void* reference) {
+	map_strings_t* strings = reference;
+	if (strings == NULL || __atomic_sub_fetch(&strings->references, 1, __ATOMIC_ACQ_REL) > 0) return;
+
+	map_block_t* block = strings->blocks;
+	while (block != NULL) {
+		map_block_t* next = block->next;
+		free(block);
+		block = next;
+	}
+	free(strings);
+}
+
 //
 //	Searches for the provided key in this map and returns the index in the entries array if it finds the key or
 //	-1 if the is not yet in the map.
@@ -181,7 +473,7 @@ int map_optimize(map_t* self) {
 //	@param key
 //		the key to search for.
 //	@param hash
-//		the modified FNV1 hash above the key.
+//		the hash of the key, see map_hash.
 //	@return
 //		the index of the key or -1 if this key is not in the map.
 //
@@ -193,6 +485,9 @@ int map_indexOf(map_t* self, const char* key, const int64_t hash) {
 	// the items array
 	map_entry_t* entries = self->entries;
 
+	// most missing keys are found missing by the filter, then the probe chain is not read
+	if (self->filter != NULL && !map_filter_test(self, hash)) return -1;
+
 	// the hash of the key
 	unsigned int i = hash & mask;
 	unsigned int l = length;
@@ -220,6 +515,19 @@ int map_indexOf(map_t* self, const char* key, const int64_t hash) {
 	return -1;
 }
 
+//
+//	Turns a hash provided by the caller into the hash of a slot. The bits are mixed, different hashes stay
+//	different, and the high bit is set like by fnv1_hash.
+//
+//	@param hash
+//		the hash of the caller.
+//	@return
+//		the hash of the slot.
+//
+static inline int64_t map_external_hash(const uint64_t hash) {
+	return (int64_t)(map_mix(hash) | 0x8000000000000000ULL);
+}
+
 //
 //	Initializes the given map and allocates memory to the map.
 //
@@ -234,6 +542,71 @@ void map_init(map_t* self) {
 	self->size = 0;
 	self->allocated = 0;
 	self->entries = memset(malloc(bytes),0,bytes);
+	self->strings = NULL;
+	self->snapshot = NULL;
+	self->wal = NULL;
+	self->resizes = 0;
+	self->reseeds = 0;
+	self->probe = 0;
+	self->hashKind = MAP_HASH_FNV1;
+	self->seed[0] = 0;
+	self->seed[1] = 0;
+	self->filter = NULL;
+	self->filterMask = 0;
+}
+
+//
+//	Initializes the given map like map_init, but with the provided hash function for the keys. MAP_HASH_SIPHASH
+//	protects a map holding keys from untrusted sources against keys that are made to collide, it costs more than
+//	FNV1 for long keys. MAP_HASH_CRC32C hashes 8 bytes per step using the CPU instructions if there are any, it is
+//	the cheapest for all but the shortest keys, but must only be used for trusted keys (see bench/map_bench.c).
+//
+//	MAP_HASH_EXTERNAL makes the caller provide the hashes to map_put_hashed, map_get_hashed and map_remove_hashed,
+//	so a hash calculated once can be used for several maps, map_put, map_get and map_remove do not work then. The
+//	map mixes the provided hashes, so hashes with patterns in their low bits (for example because they were used to
+//	select the map) spread over all slots. Such a map cannot switch to another hash, keys clustering in it make it
+//	grow, but keys with equal hashes keep long probes. It cannot have a log (the log does not store the hashes),
+//	snapshots can only be loaded from maps with external hashes as well.
+//
+//	@param self
+//		the map to be initialized.
+//	@param kind
+//		MAP_HASH_FNV1, MAP_HASH_SIPHASH, MAP_HASH_CRC32C or MAP_HASH_EXTERNAL.
+//	@param seed
+//		the two 64-bit words of the key of the hash function or NULL for a random key. Maps with the same key
+//		load each other's snapshots without hashing the keys again. Not used by FNV1 and external hashes.
+//	@return
+//		OK, NULL_POINTER or ERR_NOT_IMPLEMENTED if the hash function is unknown, then the map is not initialized.
+//
+int map_init_hash(map_t* self, const int kind, const uint64_t* seed) {
+	if (self==NULL) return NULL_POINTER;
+	if (kind < MAP_HASH_FNV1 || kind > MAP_HASH_EXTERNAL) return ERR_NOT_IMPLEMENTED;
+	map_init(self);
+	self->hashKind = kind;
+	if (kind == MAP_HASH_FNV1 || kind == MAP_HASH_EXTERNAL) return OK;
+	if (seed != NULL) {
+		self->seed[0] = seed[0];
+		self->seed[1] = seed[1];
+	} else {
+		map_hash_seed(self->seed);
+	}
+	return OK;
+}
+
+//
+//	This function is internally used to identify the hash function of the map and its key, so that a snapshot
+//	written from one map can tell whether the stored hashes are valid in another map. The key itself is not
+//	revealed, the identifier holds the kind and the hash of a constant string.
+//
+//	@param self
+//		the map.
+//	@return
+//		0 for FNV1, otherwise the kind in the highest byte and for the keyed hashes 56 bits depending on the key.
+//
+uint64_t map_hash_id(const map_t* self) {
+	if (self->hashKind == MAP_HASH_FNV1) return 0;
+	if (self->hashKind == MAP_HASH_EXTERNAL) return (uint64_t)MAP_HASH_EXTERNAL << 56;
+	return ((uint64_t)self->hashKind << 56) | (map_siphash(self->seed, "map hash id", 11) >> 8);
 }
 
 //
@@ -247,21 +620,66 @@ void map_init(map_t* self) {
 //	@param value
 //		the value.
 //	@return
-//		OK if the key-value pair was inserted or KEY_EXISTS is the key is already set.
+//		OK if the key-value pair was inserted, KEY_EXISTS is the key is already set, SYS_ERROR if the change could
+//		not be logged or ERR_NOT_IMPLEMENTED if the map has external hashes (see map_put_hashed).
 //
 int map_put(map_t* self, const char* key, const char* val) {
 	if (self==NULL || key==NULL) return NULL_POINTER;
 	if (self->magic != MAGIC) return NOT_INITIALIZED;
+	if (self->hashKind == MAP_HASH_EXTERNAL) return ERR_NOT_IMPLEMENTED;
+	return map_insert(self, key, val, map_hash(self, key));
+}
+
+//
+//	Like map_put, but with the hash of the key calculated by the caller, see map_init_hash.
+//
+//	@param self
+//		the map in which to put the key-value pair, initialized with MAP_HASH_EXTERNAL.
+//	@param key
+//		the key.
+//	@param value
+//		the value.
+//	@param hash
+//		the 64-bit hash of the key, the same key must always come with the same hash.
+//	@return
+//		OK if the key-value pair was inserted, KEY_EXISTS is the key is already set or ERR_NOT_IMPLEMENTED if the map
+//		calculates the hashes itself.
+//
+int map_put_hashed(map_t* self, const char* key, const char* val, const uint64_t hash) {
+	if (self==NULL || key==NULL) return NULL_POINTER;
+	if (self->magic != MAGIC) return NOT_INITIALIZED;
+	if (self->hashKind != MAP_HASH_EXTERNAL) return ERR_NOT_IMPLEMENTED;
+	return map_insert(self, key, val, map_external_hash(hash));
+}
 
-	const int64_t hash = fnv1_hash(key);
+//
+//	Adds a key that is not yet in the map with the provided hash, this is the body of map_put and map_put_hashed.
+//
+static int map_insert(map_t* self, const char* key, const char* val, const int64_t hash) {
 	const int i = map_indexOf(self,key,hash);
 	if (i >= 0) return KEY_EXISTS;
 
 	// if there is not enough space to add another key-value pair, make space
-	if (self->allocated >= self->capacity) map_optimize(self);
-
-	// add the key
-	return map_set(self,key,val,hash,0);
+	if (self->allocated >= self->capacity && map_optimize(self) != OK) return SYS_ERROR;
+
+	// the change is logged before it is applied, a log refusing it leaves the map without it (the changes before
+	// stay applied, a log failing to commit keeps them until map_wal_reopen)
+	map_wal_t* wal = self->wal;
+	const uint64_t committed = wal != NULL ? wal->committed : 0;
+	const size_t used = wal != NULL ? wal->used : 0;
+	if (wal != NULL && map_wal_append(wal, WAL_PUT, key, val) != OK) return SYS_ERROR;
+
+	// add the key, a put that was logged but not applied is taken back from the log
+	const int result = map_set(self,key,val,hash,0);
+	if (result != OK && wal != NULL) map_wal_cancel(wal, committed, used);
+	if (result == OK) {
+		MAP_TRACE_EVENT(self, MAP_EVENT_PUT, key);
+		MAP_COUNT(MAP_COUNTER_INSERT, 1);
+
+		// a long probe is shortened before further keys run into it, the key is added already
+		if (self->probe > MAP_PROBE_FACTOR * (unsigned int)__builtin_ctz(self->capacity)) map_bound(self);
+	}
+	return result;
 }
 
 //
@@ -275,10 +693,33 @@ int map_put(map_t* self, const char* key, const char* val) {
 //		the value (which might be null either!) of the key or null is no such key exists in the map.
 //
 const char* map_get(map_t* self, const char* key) {
-	if (self==NULL || key==NULL || self->magic != MAGIC) return NULL;
+	if (self==NULL || key==NULL || self->magic != MAGIC || self->hashKind == MAP_HASH_EXTERNAL) return NULL;
+	return map_lookup(self, key, map_hash(self, key));
+}
 
-	const int64_t hash = fnv1_hash(key);
+//
+//	Like map_get, but with the hash of the key calculated by the caller, see map_init_hash.
+//
+//	@param self
+//		the map into which to look for the key, initialized with MAP_HASH_EXTERNAL.
+//	@param key
+//		the key to search.
+//	@param hash
+//		the 64-bit hash of the key.
+//	@return
+//		the value of the key or null if no such key exists in the map or the map calculates the hashes itself.
+//
+const char* map_get_hashed(map_t* self, const char* key, const uint64_t hash) {
+	if (self==NULL || key==NULL || self->magic != MAGIC || self->hashKind != MAP_HASH_EXTERNAL) return NULL;
+	return map_lookup(self, key, map_external_hash(hash));
+}
+
+//
+//	Returns the value of a key with the provided hash, this is the body of map_get and map_get_hashed.
+//
+static const char* map_lookup(map_t* self, const char* key, const int64_t hash) {
 	const int i = map_indexOf(self,key,hash);
+	MAP_COUNT(i < 0 ? MAP_COUNTER_MISS : MAP_COUNTER_HIT, 1);
 	return i < 0 ? NULL : self->entries[i].value;
 }
 
@@ -303,36 +744,51 @@ int map_size(map_t* self) {
 //	@param key
 //		the key of the entity to be removed.
 //	@return
-//		OK if the key-value pair was removed successfully or NO_KEY_EXISTS if the provided map doesn't contain such
-//		a key.
+//		OK if the key-value pair was removed successfully, NO_KEY_EXISTS if the provided map doesn't contain such
+//		a key, SYS_ERROR if the change could not be logged or ERR_NOT_IMPLEMENTED if the map has external hashes.
 //
 int map_remove(map_t* self, const char* key) {
 	if (self==NULL || key==NULL) return NULL_POINTER;
 	if (self->magic != MAGIC) return NOT_INITIALIZED;
-
-	const int64_t hash = fnv1_hash(key);
-	const int i = map_indexOf(self,key,hash);
-	if (i >= 0) {
-		self->entries[i].key = NULL;
-		self->size--;
-		printf("\n a node was deleted\n");
-		return OK;
-	}
-	return NO_KEY_EXISTS;
+	if (self->hashKind == MAP_HASH_EXTERNAL) return ERR_NOT_IMPLEMENTED;
+	return map_delete(self, key, map_hash(self, key));
 }
 
 //
+//	Like map_remove, but with the hash of the key calculated by the caller, see map_init_hash.
 //
+//	@param self
+//		the map from which to remove the key-value pair, initialized with MAP_HASH_EXTERNAL.
+//	@param key
+//		the key of the entity to be removed.
+//	@param hash
+//		the 64-bit hash of the key.
+//	@return
+//		OK if the key-value pair was removed successfully, NO_KEY_EXISTS if the provided map doesn't contain such
+//		a key or ERR_NOT_IMPLEMENTED if the map calculates the hashes itself.
 //
-int map_serialize(map_t* self, FILE* stream) {
-	return ERR_NOT_IMPLEMENTED;
+int map_remove_hashed(map_t* self, const char* key, const uint64_t hash) {
+	if (self==NULL || key==NULL) return NULL_POINTER;
+	if (self->magic != MAGIC) return NOT_INITIALIZED;
+	if (self->hashKind != MAP_HASH_EXTERNAL) return ERR_NOT_IMPLEMENTED;
+	return map_delete(self, key, map_external_hash(hash));
 }
 
 //
+//	Removes a key with the provided hash, this is the body of map_remove and map_remove_hashed.
 //
-//
-int map_deserialize(map_t* self, FILE* stream) {
-	return ERR_NOT_IMPLEMENTED;
+static int map_delete(map_t* self, const char* key, const int64_t hash) {
+	const int i = map_indexOf(self,key,hash);
+	if (i >= 0) {
+		if (self->wal != NULL && map_wal_append(self->wal, WAL_REMOVE, key, NULL) != OK) return SYS_ERROR;
+		if (self->snapshot != NULL) map_snapshot_preserve(self->snapshot, i);
+		self->entries[i].key = NULL;
+		self->size--;
+		MAP_TRACE_EVENT(self, MAP_EVENT_REMOVE, key);
+		MAP_COUNT(MAP_COUNTER_REMOVE, 1);
+		return OK;
+	}
+	return NO_KEY_EXISTS;
 }
 
 //
@@ -344,33 +800,118 @@ int map_deserialize(map_t* self, FILE* stream) {
 void map_destroy(map_t* self) {
 	if (self==NULL) return;
 	if (self->magic != MAGIC) return;
-
-	free(self->entries);
+	MAP_TRACE_EVENT(self, MAP_EVENT_DESTROY, NULL);
+
+	// a snapshot being written keeps the entries
+	if (self->snapshot != NULL) {
+		map_snapshot_detach(self->snapshot);
+		self->snapshot = NULL;
+	} else {
+		free(self->entries);
+	}
 	self->entries = NULL;
+	free(self->filter);
+	self->filter = NULL;
+
+	// a snapshot being written may still hold the keys and values
+	map_strings_release(self->strings);
+	self->strings = NULL;
 	self->magic = 0;
-	printf("\n A destroy has been done.\n");
 }
 
 //
-//	Test.
+//	Collects statistics about the slots of the map. This scans all slots, so it costs as much as a rebuild without
+//	the allocation and should not be called on every operation.
+//
+//	@param self
+//		the map to inspect.
+//	@param stats
+//		the statistics to fill.
+//	@return
+//		OK, NULL_POINTER or NOT_INITIALIZED.
 //
-int main() {
-	map_t* m = malloc(sizeof(map_t));
-	map_init(m);
-	map_put(m, "a", "1");
-	map_put(m, "b", "2");
-	map_put(m, "c", "3");
-	map_put(m, "d", "4");
-	map_put(m, "e", "5");
-	map_put(m, "f", "This is testing the map_put functions");
-	map_put(m,"tester","tested");
+int map_stats(map_t* self, map_stats_t* stats) {
+	if (self==NULL || stats==NULL) return NULL_POINTER;
+	if (self->magic != MAGIC) return NOT_INITIALIZED;
+
+	memset(stats, 0, sizeof(map_stats_t));
+	stats->size = self->size;
+	stats->allocated = self->allocated;
+	stats->capacity = self->capacity;
+	stats->tombstones = self->allocated - self->size;
+	stats->loadFactor = (double)self->size / self->capacity;
+	stats->fillFactor = (double)self->allocated / self->capacity;
+	stats->resizes = self->resizes;
+	stats->reseeds = self->reseeds;
+
+	const unsigned int mask = self->capacity - 1;
+	uint64_t probes = 0;
+	unsigned int i;
+	for (i = 0; i < self->capacity; i++) {
+		const map_entry_t* entry = self->entries + i;
+		if (entry->key == NULL) continue;
+
+		// a lookup compares every slot from the start index of the hash up to the key, none of them is empty
+		const unsigned int probe = ((i - (unsigned int)(entry->hash & mask)) & mask) + 1;
+		probes += probe;
+		if (probe > stats->maxProbe) stats->maxProbe = probe;
+		stats->histogram[probe < MAP_STATS_HISTOGRAM ? probe - 1 : MAP_STATS_HISTOGRAM - 1]++;
+	}
+	if (self->size > 0) stats->averageProbe = (double)probes / self->size;
+
+	// the clusters wrap around the end of the array, so start behind an empty slot
+	unsigned int start = 0;
+	while (start < self->capacity && self->entries[start].hash != 0) start++;
+	if (start == self->capacity) {
+		stats->longestCluster = self->capacity;
+		return OK;
+	}
+
+	unsigned int run = 0;
+	for (i = 1; i <= self->capacity; i++) {
+		if (self->entries[(start + i) & mask].hash == 0) {
+			run = 0;
+			continue;
+		}
+		if (++run > stats->longestCluster) stats->longestCluster = run;
+	}
+	return OK;
+}
 
-	map_remove(m, "b");
-	printf("Size: %d\n", map_size(m));
-	printf("Read key 'a': %s \n", map_get(m,"a"));
-	printf("Read key 'tester': %s \n", map_get(m,"tester"));
-	map_remove(m, "tester");
-	printf("Read key 'f': %s \n", map_get(m,"f"));
+//
+//	Adds or drops the filter of the lookups of missing keys. The filter is a blocked Bloom filter with a cache line
+//	per 32 slots (2 bytes per slot, a twelfth of the slots), kept up to date by all changes of the map. A lookup of
+//	a missing key usually reads only its block, a lookup of a present key reads the block and the slots, so the
+//	filter pays off if most lookups miss and the probe chains are long. Less than one in 1000 missing keys passes
+//	the filter of a map that is less than three quarters full and is searched in the slots as before.
+//
+//	@param self
+//		the map.
+//	@param enable
+//		non-zero to build the filter from the keys of the map, zero to drop it.
+//	@return
+//		OK, NULL_POINTER, NOT_INITIALIZED or SYS_ERROR if there is no memory for the filter.
+//
+int map_filter(map_t* self, const int enable) {
+	if (self==NULL) return NULL_POINTER;
+	if (self->magic != MAGIC) return NOT_INITIALIZED;
+	if (enable) return map_filter_fill(self);
+	free(self->filter);
+	self->filter = NULL;
+	self->filterMask = 0;
 	return OK;
 }
 
+#ifdef MAP_TRACE
+//
+//	Sets the hook that receives the events of all maps: MAP_EVENT_PUT and MAP_EVENT_REMOVE with the key after the
+//	change was applied, MAP_EVENT_REBUILD when the entries array was replaced and MAP_EVENT_DESTROY before a map is
+//	destroyed (both without a key). The hook is called on the thread changing the map.
+//
+//	@param tracer
+//		the hook or NULL to stop tracing.
+//
+void map_trace_set(map_trace_t tracer) {
+	__atomic_store_n(&map_tracer, tracer, __ATOMIC_RELAXED);
+}
+#endif
@@ -21,6 +21,9 @@
 #define NOT_INITIALIZED 4
 #define ERR_NOT_IMPLEMENTED 5
 #define REQUIRES_OPTIMIZATION 6
+#define IN_PROGRESS 7
+#define INVALID_FORMAT 8
+#define UNSUPPORTED_VERSION 9
  
 // data to be stored for each slot
 typedef struct {
@@ -34,6 +37,12 @@ typedef struct {
 	int64_t hash;
 } map_entry_t;
  
+// a snapshot that is currently written from the map, see snapshot.h
+struct map_snapshot_s;
+
+// the log recording the changes of the map, see wal.h
+struct map_wal_s;
+
 // the root map struct
 typedef struct {
 	// used to detect that the map was initialized
@@ -50,18 +59,130 @@ typedef struct {
  
 	// the total amount of entries (slots)
 	unsigned int capacity;
+
+	// the memory blocks holding the keys and values owned by the map (for example loaded by map_deserialize), shared
+	// with the snapshots being written
+	void* strings;
+
+	// the snapshot being written while the map stays writable, NULL if there is none
+	struct map_snapshot_s* snapshot;
+
+	// the log to which every successful put and remove is appended, NULL if there is none
+	struct map_wal_s* wal;
+
+	// the amount of times the entries array was rebuilt
+	unsigned int resizes;
+
+	// the amount of times map_put switched to a new hash key, because the keys clustered
+	unsigned int reseeds;
+
+	// the amount of slots compared by the last insert of map_set
+	unsigned int probe;
+
+	// the hash function of the keys (MAP_HASH_FNV1, MAP_HASH_SIPHASH, MAP_HASH_CRC32C or MAP_HASH_EXTERNAL) and its
+	// key, see map_init_hash
+	int hashKind;
+	uint64_t seed[2];
+
+	// the filter answering most lookups of missing keys without probing, NULL if there is none (see map_filter), and
+	// the amount of its blocks minus one
+	uint64_t* filter;
+	unsigned int filterMask;
 } map_t;
+
+// the hash functions of the keys
+#define MAP_HASH_FNV1 0
+#define MAP_HASH_SIPHASH 1
+#define MAP_HASH_CRC32C 2
+#define MAP_HASH_EXTERNAL 3
+
+// the amount of buckets of the probe length histogram
+#define MAP_STATS_HISTOGRAM 16
+
+// the statistics of a map, see map_stats
+typedef struct {
+	// the amount of keys, of slots with a hash (keys and deleted keys) and of slots
+	unsigned int size;
+	unsigned int allocated;
+	unsigned int capacity;
+
+	// the amount of deleted keys still holding their slot
+	unsigned int tombstones;
+
+	// the keys and the slots with a hash relative to the capacity
+	double loadFactor;
+	double fillFactor;
+
+	// the amount of slots compared to find a present key: the average, the maximum and how many keys need how many
+	// slots, the bucket i counts the keys needing i + 1 slots and the last bucket all keys needing more
+	double averageProbe;
+	unsigned int maxProbe;
+	unsigned int histogram[MAP_STATS_HISTOGRAM];
+
+	// the longest run of slots with a hash, every miss starting in it scans up to its end
+	unsigned int longestCluster;
+
+	// the amount of times the entries array was rebuilt and the amount of times the keys got a new hash key
+	unsigned int resizes;
+	unsigned int reseeds;
+} map_stats_t;
+ 
+//
+//	This function calculates a modified FNV1 hash value. Modified in the way that it guarantees that the high bit is
+//	always set, therefore the hash is always negative. This means as well it may never be zero, what is what we need
+//	later on.
+//
+//	@param text
+//		the zero terminated US-ASCII encoded string to hash.
+//	@return
+//		the 64-bit hash code above the provided string.
+//
+static inline int64_t fnv1_hash( const char* text ) {
+	int64_t hash = 0xCBF29CE484222325L;
+	int i = 0;
+	char c = *(text + i++);
+	while (c != 0) {
+		hash ^= c & 0xFF;
+		hash *= 1099511628211L;
+		c = *(text + i++);
+	};
+	return hash | 0x8000000000000000L;
+}
  
 // Part one functions.
 void map_init(map_t*);
+int map_init_hash(map_t*, int, const uint64_t*);
 int map_put(map_t*, const char*, const char*);
 const char* map_get(map_t*, const char*);
 int map_remove(map_t*, const char*);
 int map_size(map_t*);
 void map_destroy(map_t*);
+
+// The operations with a hash calculated by the caller, see map_init_hash.
+int map_put_hashed(map_t*, const char*, const char*, uint64_t);
+const char* map_get_hashed(map_t*, const char*, uint64_t);
+int map_remove_hashed(map_t*, const char*, uint64_t);
  
 // Part two functions.
 int map_serialize(map_t*, FILE*);
 int map_deserialize(map_t*, FILE*);
+
+// Statistics.
+int map_stats(map_t*, map_stats_t*);
+
+// The filter of the lookups of missing keys.
+int map_filter(map_t*, int);
+
+// the events passed to the trace hook
+#define MAP_EVENT_PUT 1
+#define MAP_EVENT_REMOVE 2
+#define MAP_EVENT_REBUILD 3
+#define MAP_EVENT_DESTROY 4
+
+// Tracing, only compiled in if MAP_TRACE is defined, otherwise the events cost nothing.
+#ifdef MAP_TRACE
+typedef void (*map_trace_t)(const map_t*, int, const char*);
+void map_trace_set(map_trace_t);
+#endif
 #endif
  
@@ -0,0 +1,306 @@
+#ifndef __A1_MAP_HPP__
+#define __A1_MAP_HPP__
+
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "map.h"
+
+//
+//	A header only C++ version of the map for keys and values of any type. It works like map.c: the slots are probed
+//	linear from the hash of the key, a removed key leaves its hash behind and the map is rebuilt once all slots have
+//	a hash or an insert compared too many slots. The keys and values are stored in the slots, the hash function and
+//	the comparison are template parameters, so the compiler inlines them.
+//
+//	The return codes are the ones of map.h. Allocation failures throw std::bad_alloc.
+//
+
+namespace a1 {
+
+//
+//	Mixes the bits of an integer, so that consecutive integers spread over all slots (the finalizer of MurmurHash3).
+//
+inline uint64_t map_mix(uint64_t x) {
+	x ^= x >> 33;
+	x *= 0xFF51AFD7ED558CCDULL;
+	x ^= x >> 33;
+	x *= 0xC4CEB9FE1A85EC53ULL;
+	return x ^ (x >> 33);
+}
+
+//
+//	The FNV1 hash of fnv1_hash (without the high bit) for bytes with a length, calculated unsigned.
+//
+inline uint64_t map_fnv1(const char* p, size_t length) {
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	while (length-- > 0) {
+		hash ^= (unsigned char)*p++;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// the default hash: integers and pointers are mixed, strings use FNV1 like the C map, other types std::hash
+template <typename Key, typename Enable = void>
+struct Hash {
+	uint64_t operator()(const Key& key) const { return map_mix(std::hash<Key>()(key)); }
+};
+
+template <typename Key>
+struct Hash<Key, typename std::enable_if<std::is_integral<Key>::value || std::is_enum<Key>::value>::type> {
+	uint64_t operator()(const Key& key) const { return map_mix((uint64_t)key); }
+};
+
+template <>
+struct Hash<const char*> {
+	uint64_t operator()(const char* key) const { return map_fnv1(key, std::strlen(key)); }
+};
+
+template <>
+struct Hash<std::string> {
+	uint64_t operator()(const std::string& key) const { return map_fnv1(key.data(), key.size()); }
+};
+
+// the default comparison: operator==, zero terminated strings by their content
+template <typename Key>
+struct Equal {
+	bool operator()(const Key& a, const Key& b) const { return a == b; }
+};
+
+template <>
+struct Equal<const char*> {
+	bool operator()(const char* a, const char* b) const { return a == b || std::strcmp(a, b) == 0; }
+};
+
+template <typename Key, typename Value, typename HashFunction = Hash<Key>, typename KeyEqual = Equal<Key>>
+class Map {
+	// the high bit marks a key, a removed key keeps the other bits, so its hash is never zero
+	static const uint64_t LIVE = 0x8000000000000000ULL;
+
+	// note: must be 2^n, like MIN_EMPTY_SLOTS of map.c
+	static const unsigned int MIN_SLOTS = 8;
+
+	// an insert comparing more slots than this factor times the log2 of the capacity makes the map grow
+	static const unsigned int PROBE_FACTOR = 16;
+
+	// slots can be copied with memcpy and need no destruction if both types allow it
+	static const bool TRIVIAL = std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value;
+
+	// a slot, the key and value are only constructed while the hash has the LIVE bit
+	struct Slot {
+		uint64_t hash;
+		typename std::aligned_storage<sizeof(Key), alignof(Key)>::type key;
+		typename std::aligned_storage<sizeof(Value), alignof(Value)>::type value;
+
+		Key& k() { return *reinterpret_cast<Key*>(&key); }
+		Value& v() { return *reinterpret_cast<Value*>(&value); }
+	};
+
+	Slot* slots;
+	unsigned int size_;
+	unsigned int allocated;
+	unsigned int capacity;
+	HashFunction hasher;
+	KeyEqual equal;
+
+	//
+	//	Calculates the hash of a key with the LIVE bit and at least one other bit set.
+	//
+	uint64_t hashOf(const Key& key) const {
+		const uint64_t hash = hasher(key) & ~LIVE;
+		return (hash != 0 ? hash : 1) | LIVE;
+	}
+
+	static Slot* allocate(const unsigned int count) {
+		void* memory = std::calloc(count, sizeof(Slot));
+		if (memory == nullptr) throw std::bad_alloc();
+		return static_cast<Slot*>(memory);
+	}
+
+	//
+	//	Destroys the keys and values of all slots and releases them.
+	//
+	void release() {
+		if (slots == nullptr) return;
+		if (!std::is_trivially_destructible<Key>::value || !std::is_trivially_destructible<Value>::value) {
+			for (unsigned int i = 0; i < capacity; i++) {
+				if ((slots[i].hash & LIVE) == 0) continue;
+				slots[i].k().~Key();
+				slots[i].v().~Value();
+			}
+		}
+		std::free(slots);
+		slots = nullptr;
+	}
+
+	//
+	//	Searches the key and returns its slot or -1, like map_indexOf.
+	//
+	int indexOf(const Key& key, const uint64_t hash) const {
+		const unsigned int mask = capacity - 1;
+		unsigned int i = hash & mask;
+		for (unsigned int l = capacity; l-- > 0; i = (i + 1) & mask) {
+			Slot& slot = slots[i];
+			if (slot.hash == 0) return -1;
+			if (slot.hash == hash && equal(slot.k(), key)) return (int)i;
+		}
+		return -1;
+	}
+
+	//
+	//	Rebuilds the map with at least the provided amount of slots and drops the removed keys, like map_rebuild.
+	//	The hashes are kept, slots of trivially copyable types are copied with memcpy, the others are moved.
+	//
+	void rebuild(const unsigned int minNewSize) {
+		unsigned int length = MIN_SLOTS;
+		while (length < minNewSize) length <<= 1;
+		Slot* old = slots;
+		const unsigned int oldLength = capacity;
+		slots = allocate(length);
+		capacity = length;
+		allocated = size_;
+
+		const unsigned int mask = length - 1;
+		for (unsigned int j = 0; j < oldLength; j++) {
+			Slot& from = old[j];
+			if ((from.hash & LIVE) == 0) continue;
+			unsigned int i = from.hash & mask;
+			while (slots[i].hash != 0) i = (i + 1) & mask;
+			if (TRIVIAL) {
+				std::memcpy(&slots[i], &from, sizeof(Slot));
+			} else {
+				slots[i].hash = from.hash;
+				new (&slots[i].key) Key(std::move(from.k()));
+				new (&slots[i].value) Value(std::move(from.v()));
+				from.k().~Key();
+				from.v().~Value();
+			}
+		}
+		std::free(old);
+	}
+
+public:
+	Map() : slots(allocate(MIN_SLOTS)), size_(0), allocated(0), capacity(MIN_SLOTS) {}
+
+	~Map() { release(); }
+
+	Map(const Map&) = delete;
+	Map& operator=(const Map&) = delete;
+
+	Map(Map&& other) noexcept : slots(other.slots), size_(other.size_), allocated(other.allocated),
+			capacity(other.capacity), hasher(std::move(other.hasher)), equal(std::move(other.equal)) {
+		other.slots = nullptr;
+		other.size_ = other.allocated = other.capacity = 0;
+	}
+
+	Map& operator=(Map&& other) noexcept {
+		if (this != &other) {
+			release();
+			slots = other.slots;
+			size_ = other.size_;
+			allocated = other.allocated;
+			capacity = other.capacity;
+			hasher = std::move(other.hasher);
+			equal = std::move(other.equal);
+			other.slots = nullptr;
+			other.size_ = other.allocated = other.capacity = 0;
+		}
+		return *this;
+	}
+
+	//
+	//	Adds a key with its value, like map_put an existing key is not changed.
+	//
+	//	@param key
+	//		the key, copied into the map.
+	//	@param value
+	//		the value, copied into the map.
+	//	@return
+	//		OK if the key was added or KEY_EXISTS.
+	//
+	int put(const Key& key, const Value& value) {
+		const uint64_t hash = hashOf(key);
+		if (slots == nullptr) {
+			slots = allocate(MIN_SLOTS);
+			capacity = MIN_SLOTS;
+		}
+		if (indexOf(key, hash) >= 0) return KEY_EXISTS;
+		if (allocated >= capacity) rebuild(size_ + MIN_SLOTS);
+
+		// the first free slot or the slot of a removed key with the same hash
+		const unsigned int mask = capacity - 1;
+		unsigned int i = hash & mask;
+		unsigned int probe = 1;
+		while (slots[i].hash != 0 && slots[i].hash != (hash & ~LIVE)) {
+			i = (i + 1) & mask;
+			probe++;
+		}
+		Slot& slot = slots[i];
+		new (&slot.key) Key(key);
+		new (&slot.value) Value(value);
+		if (slot.hash == 0) allocated++;
+		slot.hash = hash;
+		size_++;
+
+		// a long probe is explained by the load, the map grows to be half full, see map_bound
+		if (probe > PROBE_FACTOR * (unsigned int)__builtin_ctz(capacity) && allocated > capacity / 4 * 3) {
+			rebuild(size_ * 2 + MIN_SLOTS);
+		}
+		return OK;
+	}
+
+	//
+	//	Looks up a key.
+	//
+	//	@param key
+	//		the key to search.
+	//	@return
+	//		the value of the key in the map or nullptr if there is no such key. The pointer is valid until the next
+	//		put, remove or optimize.
+	//
+	Value* get(const Key& key) {
+		if (slots == nullptr) return nullptr;
+		const int i = indexOf(key, hashOf(key));
+		return i < 0 ? nullptr : &slots[i].v();
+	}
+
+	const Value* get(const Key& key) const {
+		return const_cast<Map*>(this)->get(key);
+	}
+
+	//
+	//	Removes a key, its slot keeps the hash until the map is rebuilt, like map_remove.
+	//
+	//	@param key
+	//		the key to remove.
+	//	@return
+	//		OK or NO_KEY_EXISTS.
+	//
+	int remove(const Key& key) {
+		if (slots == nullptr) return NO_KEY_EXISTS;
+		const int i = indexOf(key, hashOf(key));
+		if (i < 0) return NO_KEY_EXISTS;
+		Slot& slot = slots[i];
+		slot.k().~Key();
+		slot.v().~Value();
+		slot.hash &= ~LIVE;
+		size_--;
+		return OK;
+	}
+
+	//
+	//	Rebuilds the map with space for MIN_SLOTS more keys and drops the removed keys, like map_optimize.
+	//
+	void optimize() {
+		rebuild(size_ + MIN_SLOTS);
+	}
+
+	unsigned int size() const { return size_; }
+};
+
+}
+#endif
@@ -0,0 +1,148 @@
+#ifndef __A1_MAP_INTERNAL_H__
+#define __A1_MAP_INTERNAL_H__
+
+#include <stddef.h>
+#include <string.h>
+#include "counters.h"
+#include "crc32c.h"
+#include "hash.h"
+#include "map.h"
+
+// marks an initialized map
+#define MAGIC 0x1234567890123456
+
+//
+//	Functions of map.c that are shared with the other modules of the map (snapshots, logs), but are not part of the
+//	public interface. None of them checks the magic of the map.
+//
+
+int map_set(map_t*, const char*, const char*, const int64_t, const int);
+int map_indexOf(map_t*, const char*, const int64_t);
+int map_rebuild(map_t*, unsigned int);
+int map_rehash(map_t*);
+int map_optimize(map_t*);
+int map_reserve(map_t*, unsigned int);
+char* map_alloc(map_t*, size_t);
+void* map_strings_retain(map_t*);
+void map_strings_release(void*);
+uint64_t map_hash_id(const map_t*);
+int map_filter_fill(map_t*);
+
+// The function of wal.c that map.c uses to take back an operation it could not apply.
+void map_wal_cancel(struct map_wal_s*, uint64_t, size_t);
+
+//
+//	The finalizer of MurmurHash3. It is a bijection, so different inputs stay different, and every bit of the result
+//	depends on every bit of the input, so inputs with patterns in some of their bits spread over all slots.
+//
+static inline uint64_t map_mix(uint64_t x) {
+	x ^= x >> 33;
+	x *= 0xFF51AFD7ED558CCDULL;
+	x ^= x >> 33;
+	x *= 0xC4CEB9FE1A85EC53ULL;
+	return x ^ (x >> 33);
+}
+
+// an insert comparing more slots than this factor times the log2 of the capacity has a long probe
+#define MAP_PROBE_FACTOR 16
+
+//
+//	Returns the amount of slots for the rebuild that shortens a long probe, if the load explains it. The map and
+//	the tables probing like it (imap, bmap, mset) call this after every insert.
+//
+//	@param probe
+//		the amount of slots the insert compared.
+//	@param size
+//		the amount of keys in the table.
+//	@param allocated
+//		the amount of slots with a hash, deleted keys included.
+//	@param capacity
+//		the amount of slots, 2^n.
+//	@param minEmpty
+//		the amount of empty slots of the table after a rebuild at least.
+//	@return
+//		0 if the probe was not long or the table is not more than three quarters allocated, otherwise the amount of
+//		slots that makes the table half full.
+//
+static inline unsigned int map_probe_bound(const unsigned int probe, const unsigned int size,
+		const unsigned int allocated, const unsigned int capacity, const unsigned int minEmpty) {
+	if (probe <= MAP_PROBE_FACTOR * (unsigned int)__builtin_ctz(capacity) || allocated <= capacity / 4 * 3) return 0;
+	return size < 0x40000000 ? size * 2 + minEmpty : capacity;
+}
+
+//
+//	Calculates the hash of a key with the hash function of the map. Like fnv1_hash the high bit is always set, so
+//	the hash is never zero.
+//
+static inline int64_t map_hash(const map_t* self, const char* key) {
+	switch (self->hashKind) {
+	case MAP_HASH_SIPHASH: return (int64_t)(map_siphash(self->seed, key, strlen(key)) | 0x8000000000000000ULL);
+	case MAP_HASH_CRC32C: return (int64_t)(map_crc32c_hash(self->seed, key, strlen(key)) | 0x8000000000000000ULL);
+	default: return fnv1_hash(key);
+	}
+}
+
+//
+//	Reports an event to the trace hook. Without MAP_TRACE this expands to nothing, so the hot paths do no I/O and no
+//	calls. The hook is read once per event, so it can be replaced while other threads use their maps.
+//
+#ifdef MAP_TRACE
+extern map_trace_t map_tracer;
+#define MAP_TRACE_EVENT(self, event, key) do { \
+	const map_trace_t tracer = __atomic_load_n(&map_tracer, __ATOMIC_RELAXED); \
+	if (tracer != NULL) tracer(self, event, key); \
+} while (0)
+#else
+#define MAP_TRACE_EVENT(self, event, key) ((void)0)
+#endif
+
+// the size of a cache line, the counters of two threads never share one
+#define MAP_CACHE_LINE 64
+
+// the counters of one thread, only written by that thread (see counters.h)
+typedef struct map_counter_line_s {
+	uint64_t counts[MAP_COUNTER_COUNT];
+	struct map_counter_line_s* next;
+} __attribute__((aligned(MAP_CACHE_LINE))) map_counter_line_t;
+
+extern __thread map_counter_line_t* map_counter_line;
+map_counter_line_t* map_counters_register();
+uint64_t map_counters_now();
+
+//
+//	Adds to a counter of the current thread. Without MAP_COUNTERS this expands to nothing and the arguments are not
+//	evaluated.
+//
+#ifdef MAP_COUNTERS
+static inline void map_count(const int counter, const uint64_t n) {
+	map_counter_line_t* line = map_counter_line;
+	if (line == NULL && (line = map_counters_register()) == NULL) return;
+
+	// only this thread writes the line, the atomic store only keeps map_counters_read from reading a torn value
+	__atomic_store_n(&line->counts[counter], line->counts[counter] + n, __ATOMIC_RELAXED);
+}
+#define MAP_COUNT(counter, n) map_count(counter, n)
+#else
+#define MAP_COUNT(counter, n) ((void)0)
+#endif
+
+//
+//	Helpers to store and load numbers little endian, used by the file formats.
+//
+static inline void map_store32(unsigned char* p, const uint32_t v) {
+	p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static inline void map_store64(unsigned char* p, const uint64_t v) {
+	map_store32(p, (uint32_t)v);
+	map_store32(p + 4, (uint32_t)(v >> 32));
+}
+
+static inline uint32_t map_load32(const unsigned char* p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t map_load64(const unsigned char* p) {
+	return map_load32(p) | ((uint64_t)map_load32(p + 4) << 32);
+}
+#endif
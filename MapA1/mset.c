@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "mset.h"
+#include "map_internal.h"
+
+// note: must be 2^n, default is 8
+#define MSET_MIN_EMPTY_SLOTS (1 << 3)
+
+#define MSET_MAGIC 0x123456789012345A
+
+_Static_assert(sizeof(mset_entry_t) == 16, "a slot of the set must be 16 bytes");
+
+
+//
+//	The set probes, removes and rebuilds like the map, its slots only hold the key and its hash. All sets hash with
+//	fnv1_hash, so mset_union and mset_intersect take the hashes from the slots of the other set and only compare the
+//	keys whose hashes match.
+//
+
+
+//
+//	Searches for the provided key and returns its slot or -1 if the key is not in the set, like map_indexOf.
+//
+//	@param self
+//		the set to search in.
+//	@param key
+//		the key to search for.
+//	@param hash
+//		the modified FNV1 hash above the key.
+//	@return
+//		the slot of the key or -1 if this key is not in the set.
+//
+static int mset_indexOf(mset_t* self, const char* key, const int64_t hash) {
+	const unsigned int mask = self->capacity - 1;
+	const mset_entry_t* entries = self->entries;
+	unsigned int i = hash & mask;
+	unsigned int l = self->capacity;
+
+	while (l-- > 0) {
+		const mset_entry_t* entry = entries + i;
+
+		// as soon as we hit an empty hash we can be sure that this key is not in the set
+		if (entry->hash == 0) return -1;
+		if (entry->hash == hash && entry->key != NULL && (entry->key == key || strcmp(entry->key, key) == 0)) return i;
+
+		i = (i+1) & mask;
+	}
+	return -1;
+}
+
+//
+//	Rebuilds the set with at least the provided amount of slots and drops the deleted ones, like map_rebuild.
+//
+//	@param self
+//		the pointer to the set struct.
+//	@param minNewSize
+//		the minimal amount of slots the set must have afterwards.
+//	@return
+//		OK or SYS_ERROR.
+//
+static int mset_rebuild(mset_t* self, const unsigned int minNewSize) {
+	unsigned int newLength = MSET_MIN_EMPTY_SLOTS;
+	while (newLength < minNewSize) newLength <<= 1;
+	mset_entry_t* newEntries = calloc(newLength, sizeof(mset_entry_t));
+	if (newEntries == NULL) return SYS_ERROR;
+
+	const unsigned int mask = newLength - 1;
+	unsigned int j;
+	for (j = 0; j < self->capacity; j++) {
+		const mset_entry_t* entry = self->entries + j;
+		if (entry->key == NULL) continue;
+
+		// no key can exist twice so we only need to find an empty slot
+		unsigned int i = entry->hash & mask;
+		while (newEntries[i].hash != 0) i = (i+1) & mask;
+		newEntries[i] = *entry;
+	}
+
+	free(self->entries);
+	self->entries = newEntries;
+	self->capacity = newLength;
+	self->allocated = self->size;
+	return OK;
+}
+
+//
+//	Adds a key that is not in the set, like map_set. The key takes the first empty slot or the slot of a deleted
+//	key with the same hash.
+//
+//	@param self
+//		the pointer to the set struct.
+//	@param key
+//		the key to add.
+//	@param hash
+//		the modified FNV1 hash above the key.
+//	@return
+//		OK or SYS_ERROR if the set could not grow.
+//
+static int mset_insert(mset_t* self, const char* key, const int64_t hash) {
+	// if there is not enough space to add another key, make space
+	if (self->allocated >= self->capacity && mset_rebuild(self, self->size + MSET_MIN_EMPTY_SLOTS) != OK) {
+		return SYS_ERROR;
+	}
+
+	const unsigned int mask = self->capacity - 1;
+	unsigned int i = hash & mask;
+	unsigned int probe = 1;
+	while (self->entries[i].hash != 0 && (self->entries[i].hash != hash || self->entries[i].key != NULL)) {
+		i = (i+1) & mask;
+		probe++;
+	}
+
+	mset_entry_t* entry = self->entries + i;
+	if (entry->hash == 0) self->allocated++;
+	entry->key = key;
+	entry->hash = hash;
+	self->size++;
+
+	// all sets must keep FNV1 for mset_union and mset_intersect, so only a full set grows to shorten a long probe
+	const unsigned int slots = map_probe_bound(probe, self->size, self->allocated, self->capacity, MSET_MIN_EMPTY_SLOTS);
+	if (slots > 0) mset_rebuild(self, slots);
+	return OK;
+}
+
+//
+//	Initializes the given set and allocates memory to the set.
+//
+//	@param self
+//		the set to be initialized.
+//
+void mset_init(mset_t* self) {
+	if (self == NULL) return;
+	self->magic = MSET_MAGIC;
+	self->capacity = MSET_MIN_EMPTY_SLOTS;
+	self->size = 0;
+	self->allocated = 0;
+	self->entries = calloc(self->capacity, sizeof(mset_entry_t));
+}
+
+//
+//	Adds the provided key to the set.
+//
+//	@param self
+//		the set in which to add the key.
+//	@param key
+//		the key, it is not copied.
+//	@return
+//		OK if the key was added, KEY_EXISTS if the key is already in the set or SYS_ERROR if the set could not
+//		grow.
+//
+int mset_add(mset_t* self, const char* key) {
+	if (self == NULL || key == NULL) return NULL_POINTER;
+	if (self->magic != MSET_MAGIC) return NOT_INITIALIZED;
+
+	const int64_t hash = fnv1_hash(key);
+	if (mset_indexOf(self, key, hash) >= 0) return KEY_EXISTS;
+	return mset_insert(self, key, hash);
+}
+
+//
+//	Checks if the provided key is in the set.
+//
+//	@param self
+//		the set into which to look for the key.
+//	@param key
+//		the key to search.
+//	@return
+//		1 if the key is in the set, 0 if not or if the set or key is NULL.
+//
+int mset_contains(mset_t* self, const char* key) {
+	if (self == NULL || key == NULL || self->magic != MSET_MAGIC) return 0;
+	return mset_indexOf(self, key, fnv1_hash(key)) >= 0;
+}
+
+//
+//	Removes the provided key from the set.
+//
+//	@param self
+//		the set from which to remove the key.
+//	@param key
+//		the key to be removed.
+//	@return
+//		OK if the key was removed successfully or NO_KEY_EXISTS if the provided set doesn't contain such a key.
+//
+int mset_remove(mset_t* self, const char* key) {
+	if (self == NULL || key == NULL) return NULL_POINTER;
+	if (self->magic != MSET_MAGIC) return NOT_INITIALIZED;
+
+	const int i = mset_indexOf(self, key, fnv1_hash(key));
+	if (i < 0) return NO_KEY_EXISTS;
+	self->entries[i].key = NULL;
+	self->size--;
+	return OK;
+}
+
+//
+//	Returns the amount of keys stored in the provided set.
+//
+//	@param self
+//		the set for which to return the size.
+//	@return
+//		the amount of keys stored in the provided set.
+//
+int mset_size(mset_t* self) {
+	if (self == NULL || self->magic != MSET_MAGIC) return 0;
+	return self->size;
+}
+
+//
+//	Adds all keys of the other set to this set. The slots of the other set are scanned in memory order and their
+//	hashes are reused. The set is grown once up front, so it does not rebuild while the keys are added.
+//
+//	@param self
+//		the set receiving the keys.
+//	@param other
+//		the set whose keys are added, unchanged. The keys are not copied, they must live as long as this set.
+//	@return
+//		OK, NULL_POINTER, NOT_INITIALIZED or SYS_ERROR if the set could not grow (some keys may have been added).
+//
+int mset_union(mset_t* self, mset_t* other) {
+	if (self == NULL || other == NULL) return NULL_POINTER;
+	if (self->magic != MSET_MAGIC || other->magic != MSET_MAGIC) return NOT_INITIALIZED;
+	if (self == other) return OK;
+
+	// room for all keys without filling more than half of the slots
+	const unsigned int total = self->size + other->size;
+	if (total > self->capacity / 2 && mset_rebuild(self, total * 2) != OK) return SYS_ERROR;
+
+	unsigned int j;
+	for (j = 0; j < other->capacity; j++) {
+		const mset_entry_t* entry = other->entries + j;
+		if (entry->key == NULL || mset_indexOf(self, entry->key, entry->hash) >= 0) continue;
+		if (mset_insert(self, entry->key, entry->hash) != OK) return SYS_ERROR;
+	}
+	return OK;
+}
+
+//
+//	Removes all keys from this set that are not in the other set. The slots of this set are scanned in memory order
+//	and their hashes are reused to look up the other set.
+//
+//	@param self
+//		the set to reduce.
+//	@param other
+//		the set whose keys are kept, unchanged.
+//	@return
+//		OK, NULL_POINTER or NOT_INITIALIZED.
+//
+int mset_intersect(mset_t* self, mset_t* other) {
+	if (self == NULL || other == NULL) return NULL_POINTER;
+	if (self->magic != MSET_MAGIC || other->magic != MSET_MAGIC) return NOT_INITIALIZED;
+	if (self == other) return OK;
+
+	unsigned int j;
+	for (j = 0; j < self->capacity; j++) {
+		mset_entry_t* entry = self->entries + j;
+		if (entry->key == NULL || mset_indexOf(other, entry->key, entry->hash) >= 0) continue;
+		entry->key = NULL;
+		self->size--;
+	}
+	return OK;
+}
+
+//
+//	Frees the memory allocated for the set.
+//
+//	@param self
+//		the set to destroy and for which to release memory.
+//
+void mset_destroy(mset_t* self) {
+	if (self == NULL) return;
+	if (self->magic != MSET_MAGIC) return;
+
+	free(self->entries);
+	self->entries = NULL;
+	self->magic = 0;
+}
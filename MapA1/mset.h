@@ -0,0 +1,46 @@
+#ifndef __A1_MSET_H__
+#define __A1_MSET_H__
+
+#include "map.h"
+
+//
+//	The set is the map without values, for membership checks. A slot holds the key and its hash, 16 bytes instead
+//	of the 24 bytes of a map_entry_t. Like the map, the set does not copy the keys.
+//
+
+// a slot, 16 bytes
+typedef struct {
+	// if the key is NULL, then this entry counts as deleted
+	const char* key;
+
+	// the hash value of the key, zero if the slot is empty
+	int64_t hash;
+} mset_entry_t;
+
+// the root set struct
+typedef struct {
+	// used to detect that the set was initialized
+	int64_t magic;
+
+	// a pointer to the entries (basically an array of slots)
+	mset_entry_t* entries;
+
+	// the amount of keys in the set
+	unsigned int size;
+
+	// the amount of slots being allocated, that means that have fixed hash values
+	unsigned int allocated;
+
+	// the total amount of entries (slots), always 2^n
+	unsigned int capacity;
+} mset_t;
+
+void mset_init(mset_t*);
+int mset_add(mset_t*, const char*);
+int mset_contains(mset_t*, const char*);
+int mset_remove(mset_t*, const char*);
+int mset_size(mset_t*);
+int mset_union(mset_t*, mset_t*);
+int mset_intersect(mset_t*, mset_t*);
+void mset_destroy(mset_t*);
+#endif
@@ -0,0 +1,319 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "omap.h"
+
+// note: must be 2^n, default is 8
+#define OMAP_MIN_EMPTY_SLOTS (1 << 3)
+
+#define OMAP_MAGIC 0x1234567890123457
+
+
+//
+//	The ordered map splits the entries from the hash table. New entries are always appended to the end of the dense
+//	entries array and the hash table (the index) only stores the position of the entry plus one, so that zero can
+//	mark an empty slot. The index uses linear probing like the map does and compares the hash stored in the entry
+//	before it compares the key.
+//
+//	If a key is removed, the key of its entry is set to NULL and the index slot keeps pointing to that dead entry,
+//	so the probe chains stay intact. The index slot of a dead entry can be taken over by the next key that probes
+//	through it, the dead entry itself is only dropped when the map is optimized.
+//
+//	The entries array is sized to 3/4 of the index, as soon as it is used up the map is optimized, which compacts
+//	the entries (keeping their order) and re-indexes them (without re-calculating the hashes).
+//
+
+
+//
+//	Reads the index slot at the provided position.
+//
+//	@param self
+//		pointer to the ordered map.
+//	@param i
+//		the position of the slot in the index.
+//	@return
+//		the position of the entry plus one or zero if the slot is empty.
+//
+static inline unsigned int omap_slot(const omap_t* self, const unsigned int i) {
+	switch (self->width) {
+		case 1: return ((const uint8_t*)self->index)[i];
+		case 2: return ((const uint16_t*)self->index)[i];
+		default: return ((const uint32_t*)self->index)[i];
+	}
+}
+
+//
+//	Writes the index slot at the provided position.
+//
+//	@param self
+//		pointer to the ordered map.
+//	@param i
+//		the position of the slot in the index.
+//	@param value
+//		the position of the entry plus one.
+//
+static inline void omap_store(omap_t* self, const unsigned int i, const unsigned int value) {
+	switch (self->width) {
+		case 1: ((uint8_t*)self->index)[i] = (uint8_t)value; break;
+		case 2: ((uint16_t*)self->index)[i] = (uint16_t)value; break;
+		default: ((uint32_t*)self->index)[i] = (uint32_t)value; break;
+	}
+}
+
+//
+//	Searches for the provided key and returns its position in the entries array or -1 if the key is not in the map.
+//	If the key is not found, the index slot where the key can be placed is stored in free, this is either the first
+//	slot pointing to a dead entry or the empty slot that ended the search.
+//
+//	@param self
+//		the ordered map to search in.
+//	@param key
+//		the key to search for.
+//	@param hash
+//		the modified FNV1 hash above the key.
+//	@param free
+//		receives the index slot for the key, may be NULL.
+//	@return
+//		the position of the key in the entries array or -1 if this key is not in the map.
+//
+static int omap_indexOf(omap_t* self, const char* key, const int64_t hash, unsigned int* free) {
+	const unsigned int mask = self->capacity - 1;
+	map_entry_t* entries = self->entries;
+	unsigned int i = hash & mask;
+	unsigned int l = self->capacity;
+	int reuse = -1;
+
+	while (l-- > 0) {
+		const unsigned int slot = omap_slot(self, i);
+
+		// as soon as we hit an empty slot we can be sure that this key is not in the map
+		if (slot == 0) {
+			if (free != NULL) *free = reuse >= 0 ? (unsigned int)reuse : i;
+			return -1;
+		}
+
+		map_entry_t* entry = entries + slot - 1;
+		if (entry->key == NULL) {
+			// a dead entry, remember the first one so the key can take over the slot
+			if (reuse < 0) reuse = i;
+		} else if (entry->hash == hash && (entry->key == key || strcmp(entry->key, key) == 0)) {
+			return slot - 1;
+		}
+
+		i = (i+1) & mask;
+	}
+
+	// the index is never full, because the entries array is smaller than the index
+	if (free != NULL) *free = (unsigned int)reuse;
+	return -1;
+}
+
+//
+//	Optimizes the ordered map. The valid entries are moved to the front of a new entries array (in the same order)
+//	and a new index is built, ensuring that there is space for at least OMAP_MIN_EMPTY_SLOTS further keys.
+//
+//	@param self
+//		the pointer to the ordered map struct.
+//	@return
+//		OK or SYS_ERROR.
+//
+static int omap_optimize(omap_t* self) {
+	// the index must be 2^n, the entries array 3/4 of it
+	const unsigned int minNewSize = self->size + OMAP_MIN_EMPTY_SLOTS;
+	unsigned int newCapacity = OMAP_MIN_EMPTY_SLOTS;
+	while (newCapacity - (newCapacity >> 2) < minNewSize) newCapacity <<= 1;
+	const unsigned int newLimit = newCapacity - (newCapacity >> 2);
+
+	// the index slots only need to address the entries array
+	const unsigned int newWidth = newLimit < 0xFF ? 1 : newLimit < 0xFFFF ? 2 : 4;
+
+	map_entry_t* newEntries = malloc(sizeof(map_entry_t) * newLimit);
+	void* newIndex = calloc(newCapacity, newWidth);
+	if (newEntries == NULL || newIndex == NULL) {
+		free(newEntries);
+		free(newIndex);
+		return SYS_ERROR;
+	}
+
+	map_entry_t* oldEntries = self->entries;
+	const unsigned int oldUsed = self->used;
+	free(self->index);
+	self->entries = newEntries;
+	self->index = newIndex;
+	self->width = newWidth;
+	self->limit = newLimit;
+	self->capacity = newCapacity;
+
+	// compact the valid entries and index them, no key can exist twice so we only need to find an empty slot
+	const unsigned int mask = newCapacity - 1;
+	unsigned int n = 0;
+	unsigned int j;
+	for (j = 0; j < oldUsed; j++) {
+		if (oldEntries[j].key == NULL) continue;
+		newEntries[n++] = oldEntries[j];
+
+		unsigned int i = oldEntries[j].hash & mask;
+		while (omap_slot(self, i) != 0) i = (i+1) & mask;
+		omap_store(self, i, n);
+	}
+	self->used = n;
+
+	free(oldEntries);
+	return OK;
+}
+
+//
+//	Initializes the given ordered map and allocates memory to the map.
+//
+//	@param self
+//		the ordered map to be initialized.
+//
+void omap_init(omap_t* self) {
+	if (self == NULL) return;
+	self->magic = OMAP_MAGIC;
+	self->capacity = OMAP_MIN_EMPTY_SLOTS;
+	self->limit = OMAP_MIN_EMPTY_SLOTS - (OMAP_MIN_EMPTY_SLOTS >> 2);
+	self->width = 1;
+	self->size = 0;
+	self->used = 0;
+	self->entries = malloc(sizeof(map_entry_t) * self->limit);
+	self->index = calloc(self->capacity, self->width);
+}
+
+//
+//	Appends the provided key-value pair to the ordered map and returns OK if this was successfull or KEY_EXISTS if
+//	the key exists already.
+//
+//	@param self
+//		the ordered map in which to put the key-value pair.
+//	@param key
+//		the key.
+//	@param value
+//		the value.
+//	@return
+//		OK if the key-value pair was inserted, KEY_EXISTS is the key is already set or SYS_ERROR if the map could
+//		not grow.
+//
+int omap_put(omap_t* self, const char* key, const char* val) {
+	if (self == NULL || key == NULL) return NULL_POINTER;
+	if (self->magic != OMAP_MAGIC) return NOT_INITIALIZED;
+
+	const int64_t hash = fnv1_hash(key);
+	unsigned int slot;
+	if (omap_indexOf(self, key, hash, &slot) >= 0) return KEY_EXISTS;
+
+	// if the entries array is used up, compact or grow the map and search the slot again
+	if (self->used >= self->limit) {
+		if (omap_optimize(self) != OK) return SYS_ERROR;
+		omap_indexOf(self, key, hash, &slot);
+	}
+
+	map_entry_t* entry = self->entries + self->used++;
+	entry->key = key;
+	entry->value = val;
+	entry->hash = hash;
+	omap_store(self, slot, self->used);
+	self->size++;
+	return OK;
+}
+
+//
+//	Looks up for the provided key and returns its value.
+//
+//	@param self
+//		the ordered map into which to look for the key.
+//	@param key
+//		the key to search.
+//	@return
+//		the value (which might be null either!) of the key or null is no such key exists in the map.
+//
+const char* omap_get(omap_t* self, const char* key) {
+	if (self == NULL || key == NULL || self->magic != OMAP_MAGIC) return NULL;
+
+	const int i = omap_indexOf(self, key, fnv1_hash(key), NULL);
+	return i < 0 ? NULL : self->entries[i].value;
+}
+
+//
+//	Removes the key-value pair with the given key from the ordered map.
+//
+//	@param self
+//		the ordered map from which to remove the key-value pair.
+//	@param key
+//		the key of the entity to be removed.
+//	@return
+//		OK if the key-value pair was removed successfully or NO_KEY_EXISTS if the provided map doesn't contain such
+//		a key.
+//
+int omap_remove(omap_t* self, const char* key) {
+	if (self == NULL || key == NULL) return NULL_POINTER;
+	if (self->magic != OMAP_MAGIC) return NOT_INITIALIZED;
+
+	const int i = omap_indexOf(self, key, fnv1_hash(key), NULL);
+	if (i < 0) return NO_KEY_EXISTS;
+
+	self->entries[i].key = NULL;
+	self->entries[i].value = NULL;
+	self->size--;
+	return OK;
+}
+
+//
+//	Returns the amount of key-value pairs stored in the provided ordered map.
+//
+//	@param self
+//		the ordered map for which to return the size.
+//	@return
+//		the amount of key-value pairs stored in the provided map.
+//
+int omap_size(omap_t* self) {
+	if (self == NULL || self->magic != OMAP_MAGIC) return 0;
+	return self->size;
+}
+
+//
+//	Iterates the key-value pairs in the order they were inserted. The cursor must be zero for the first call and is
+//	advanced by every call. The map must not be modified while iterating, except for removing the current key.
+//
+//	@param self
+//		the ordered map to iterate.
+//	@param cursor
+//		the iteration state, zero to start at the first key-value pair.
+//	@param key
+//		receives the key of the next key-value pair.
+//	@param value
+//		receives the value of the next key-value pair, may be NULL.
+//	@return
+//		1 if a key-value pair was returned or 0 if the iteration is done.
+//
+int omap_next(omap_t* self, unsigned int* cursor, const char** key, const char** value) {
+	if (self == NULL || cursor == NULL || key == NULL || self->magic != OMAP_MAGIC) return 0;
+
+	// the entries are dense, so this only skips over removed entries
+	while (*cursor < self->used) {
+		const map_entry_t* entry = self->entries + (*cursor)++;
+		if (entry->key != NULL) {
+			*key = entry->key;
+			if (value != NULL) *value = entry->value;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//
+//	Frees the memory allocated for the ordered map.
+//
+//	@param self
+//		the ordered map to destroy and for which to release memory.
+//
+void omap_destroy(omap_t* self) {
+	if (self == NULL) return;
+	if (self->magic != OMAP_MAGIC) return;
+
+	free(self->entries);
+	free(self->index);
+	self->entries = NULL;
+	self->index = NULL;
+	self->magic = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef __A1_OMAP_H__
+#define __A1_OMAP_H__
+
+#include "map.h"
+
+//
+//	The ordered map is an alternative layout of the map. The entries live in a dense array in the order they were
+//	inserted and the hash table only holds small integer indices into that array. Scanning therefore only touches
+//	valid entries, the iteration order is deterministic and the table costs 1, 2 or 4 bytes per slot instead of a
+//	full map_entry_t.
+//
+
+// the root ordered map struct
+typedef struct {
+	// used to detect that the map was initialized
+	int64_t magic;
+
+	// the dense array of entries in insertion order, removed entries have a NULL key
+	map_entry_t* entries;
+
+	// the sparse index, every slot holds the position in entries plus one, zero marks an empty slot
+	void* index;
+
+	// the size of one index slot in bytes (1, 2 or 4), depends at the amount of entries
+	unsigned int width;
+
+	// the amount of valid entries in the map
+	unsigned int size;
+
+	// the amount of entries appended to the entries array (valid and removed ones)
+	unsigned int used;
+
+	// the length of the entries array
+	unsigned int limit;
+
+	// the total amount of index slots, always 2^n
+	unsigned int capacity;
+} omap_t;
+
+void omap_init(omap_t*);
+int omap_put(omap_t*, const char*, const char*);
+const char* omap_get(omap_t*, const char*);
+int omap_remove(omap_t*, const char*);
+int omap_size(omap_t*);
+int omap_next(omap_t*, unsigned int*, const char**, const char**);
+void omap_destroy(omap_t*);
+#endif
@@ -0,0 +1,1201 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "map.h"
+#include "map_internal.h"
+#include "crc32c.h"
+#include "lz.h"
+#include "snapshot.h"
+
+// the size of the stream header and of a block header, both end with their checksum
+#define SNAPSHOT_HEADER 48
+#define SNAPSHOT_BLOCK_HEADER 20
+#define SNAPSHOT_CHECKSUM 16
+
+// the size of a record without the key and value
+#define SNAPSHOT_RECORD 16
+
+// a block may never be larger than this, otherwise the stream is considered to be corrupted
+#define SNAPSHOT_MAX_BLOCK (1 << 30)
+
+// the size of the image header and trailer and the amount of slots converted at once while writing an image
+#define IMAGE_HEADER 64
+#define IMAGE_TRAILER 8
+#define IMAGE_CHUNK 1024
+
+// the amount of bytes read at once while validating
+#define VALIDATE_BUFFER (1 << 20)
+
+// the blocks read and decoded at once while loading
+#define SNAPSHOT_BATCH_BLOCKS 64
+#define SNAPSHOT_BATCH_BYTES (8 << 20)
+
+// the maximal amount of threads decoding blocks
+#define SNAPSHOT_MAX_THREADS 8
+
+// a block read while loading
+typedef struct {
+	// the block as stored in the stream, its size and the size of the records after decompression
+	unsigned char* stored;
+	uint32_t storedSize;
+	uint32_t rawSize;
+
+	// the header of the block, the checksum covers it and the stored block
+	unsigned char head[SNAPSHOT_BLOCK_HEADER];
+
+	// the chunk of slots the block was written from
+	uint32_t chunk;
+
+	// the map whose hash function replaces the stored hashes, NULL if they are valid in the map
+	const map_t* rehash;
+
+	// the amount of records and the decoded entries, the keys and values point into strings
+	uint32_t records;
+	map_entry_t* entries;
+	char* strings;
+
+	// the amount of entries at the start of entries that were not placed by an inserter
+	uint32_t deferred;
+
+	// the result of decoding the block
+	int result;
+} snapshot_block_t;
+
+// the blocks decoded by one thread: every step-th block starting with first
+typedef struct {
+	snapshot_block_t* blocks;
+	unsigned int count;
+	unsigned int first;
+	unsigned int step;
+} snapshot_decoder_t;
+
+// the blocks placed by one thread: the blocks from first to last, into the slots from low to high
+typedef struct {
+	map_entry_t* slots;
+	unsigned int mask;
+	snapshot_block_t* blocks;
+	unsigned int first;
+	unsigned int last;
+	unsigned int low;
+	unsigned int high;
+
+	// the amount of entries placed
+	unsigned int placed;
+} snapshot_inserter_t;
+
+
+//
+//	The stream starts with a header, followed by blocks of records and ends with an empty block. All numbers are
+//	stored little endian.
+//
+//	header:	uint64 magic, uint32 version, uint32 flags, uint64 amount of entries, uint64 capacity of the map,
+//			uint64 hash function (see map_hash_id), uint32 checksum, uint32 reserved
+//	block:	uint32 stored size in bytes, uint32 amount of records, uint32 size of the records in bytes, uint32 chunk,
+//			uint32 checksum, records
+//	record:	int64 hash, uint32 key length, uint32 value length (SNAPSHOT_NULL if the value is NULL), key, value
+//
+//	The hash is stored, so that loading the map does not need to re-calculate it, unless the map loading the stream
+//	has another hash function or another key than the one written to the header. Every block holds the valid
+//	entries of one chunk of SNAPSHOT_CHUNK slots. If the stored size is smaller than the size of the records, the
+//	records are compressed (see lz.h). Every block is compressed on its own, so that the blocks can be decompressed
+//	by several threads at once.
+//
+//	The checksums are CRC32C (see crc32c.h). The one of the header covers the header before it, the one of a block
+//	covers the block header before it and the stored records, so a block can be checked without decompressing it.
+//	The empty block at the end has a checksum as well, so a truncated stream is always detected.
+//
+//	The blocks are partitioned by the hash: a block holds the entries of one chunk of slots and the chunks are
+//	written in ascending order, so the entries of a block have the hashes that select the slots of that chunk (or
+//	of the chunks before it, if the entry was moved by a collision). When loading into an empty map of the same
+//	capacity, every thread can therefore place the entries of a range of blocks into the range of slots of these
+//	chunks without any locking. Only entries that are not placed in the range of their thread (because their probe
+//	leaves the range) are added afterwards by the calling thread.
+//
+
+
+//
+//	Stores the checksum of a header and the bytes following it into the header.
+//
+//	@param header
+//		the header, the checksum is stored at SNAPSHOT_CHECKSUM.
+//	@param bytes
+//		the bytes following the header.
+//	@param length
+//		the amount of bytes following the header.
+//
+static void snapshot_seal(unsigned char* header, const unsigned char* bytes, const size_t length) {
+	map_store32(header + SNAPSHOT_CHECKSUM, map_crc32c(map_crc32c(0, header, SNAPSHOT_CHECKSUM), bytes, length));
+}
+
+//
+//	Checks the checksum of a header and the bytes following it.
+//
+//	@param header
+//		the header, the checksum is stored at SNAPSHOT_CHECKSUM.
+//	@param bytes
+//		the bytes following the header.
+//	@param length
+//		the amount of bytes following the header.
+//	@return
+//		OK or INVALID_FORMAT.
+//
+static int snapshot_check(const unsigned char* header, const unsigned char* bytes, const size_t length) {
+	const uint32_t checksum = map_crc32c(map_crc32c(0, header, SNAPSHOT_CHECKSUM), bytes, length);
+	return checksum == map_load32(header + SNAPSHOT_CHECKSUM) ? OK : INVALID_FORMAT;
+}
+
+//
+//	Ensures that the encoding buffer of the snapshot can hold the provided amount of bytes.
+//
+//	@param buffer
+//		pointer to the buffer, which is replaced if it grows.
+//	@param length
+//		pointer to the length of the buffer.
+//	@param bytes
+//		the amount of bytes needed.
+//	@return
+//		OK or SYS_ERROR.
+//
+static int snapshot_grow(unsigned char** buffer, size_t* length, const size_t bytes) {
+	if (*length >= bytes) return OK;
+
+	size_t newLength = *length > 0 ? *length : 4096;
+	while (newLength < bytes) newLength <<= 1;
+	unsigned char* newBuffer = realloc(*buffer, newLength);
+	if (newBuffer == NULL) return SYS_ERROR;
+	*buffer = newBuffer;
+	*length = newLength;
+	return OK;
+}
+
+//
+//	Writes bytes to the stream or the file of the snapshot.
+//
+//	@param snapshot
+//		the snapshot.
+//	@param bytes
+//		the bytes to write.
+//	@param length
+//		the amount of bytes.
+//	@return
+//		OK or SYS_ERROR.
+//
+static int snapshot_write(map_snapshot_t* snapshot, const void* bytes, const size_t length) {
+	if (snapshot->aio != NULL) return map_aio_write(snapshot->aio, bytes, length);
+	return fwrite(bytes, length, 1, snapshot->stream) == 1 ? OK : SYS_ERROR;
+}
+
+//
+//	Reads bytes from a stream or a file.
+//
+//	@param stream
+//		the stream to read from, if aio is NULL.
+//	@param aio
+//		the file to read from or NULL.
+//	@param bytes
+//		the buffer for the bytes.
+//	@param length
+//		the amount of bytes.
+//	@return
+//		OK, INVALID_FORMAT if the stream ended before or SYS_ERROR.
+//
+static int snapshot_read(FILE* stream, map_aio_t* aio, void* bytes, const size_t length) {
+	if (aio != NULL) return map_aio_read(aio, bytes, length);
+	return fread(bytes, length, 1, stream) == 1 ? OK : INVALID_FORMAT;
+}
+
+//
+//	Begins to write a snapshot to a stream or a file and writes the header.
+//
+static int snapshot_begin(map_snapshot_t* snapshot, map_t* map, FILE* stream, map_aio_t* aio, const int flags) {
+	if (map->magic != MAGIC) return NOT_INITIALIZED;
+	if (map->snapshot != NULL) return IN_PROGRESS;
+
+	memset(snapshot, 0, sizeof(map_snapshot_t));
+	snapshot->map = map;
+	snapshot->entries = map->entries;
+	snapshot->capacity = map->capacity;
+	snapshot->chunks = (map->capacity + SNAPSHOT_CHUNK - 1) / SNAPSHOT_CHUNK;
+	snapshot->stream = stream;
+	snapshot->aio = aio;
+	snapshot->flags = flags;
+	snapshot->copies = calloc(snapshot->chunks, sizeof(map_entry_t*));
+	if (snapshot->copies == NULL) return SYS_ERROR;
+	snapshot->strings = map_strings_retain(map);
+
+	unsigned char header[SNAPSHOT_HEADER];
+	map_store64(header, SNAPSHOT_MAGIC);
+	map_store32(header + 8, SNAPSHOT_VERSION);
+	map_store32(header + 12, flags);
+	map_store64(header + 16, map->size);
+	map_store64(header + 24, map->capacity);
+	map_store64(header + 32, map_hash_id(map));
+	map_store32(header + 44, 0);
+	map_store32(header + 40, map_crc32c(0, header, 40));
+	if (snapshot_write(snapshot, header, SNAPSHOT_HEADER) != OK) {
+		free(snapshot->copies);
+		snapshot->copies = NULL;
+		map_strings_release(snapshot->strings);
+		snapshot->strings = NULL;
+		return SYS_ERROR;
+	}
+
+	map->snapshot = snapshot;
+	return OK;
+}
+
+//
+//	Begins to write a snapshot of the provided map to the provided stream and writes the header. The map is attached
+//	to the snapshot until map_snapshot_end is called.
+//
+//	@param snapshot
+//		the snapshot to initialize.
+//	@param map
+//		the map to write.
+//	@param stream
+//		the stream to write to.
+//	@param flags
+//		SNAPSHOT_COMPRESS to compress the blocks or 0.
+//	@return
+//		OK, NULL_POINTER, NOT_INITIALIZED, IN_PROGRESS if the map is already being written or SYS_ERROR.
+//
+int map_snapshot_begin(map_snapshot_t* snapshot, map_t* map, FILE* stream, const int flags) {
+	if (snapshot == NULL || map == NULL || stream == NULL) return NULL_POINTER;
+	return snapshot_begin(snapshot, map, stream, NULL, flags);
+}
+
+//
+//	Begins to write a snapshot of the provided map to a file opened with map_aio_open for writing, like
+//	map_snapshot_begin. The file must stay open until the snapshot ended and is only complete after map_aio_close
+//	returned OK.
+//
+//	@param snapshot
+//		the snapshot to initialize.
+//	@param map
+//		the map to write.
+//	@param aio
+//		the file to write to.
+//	@param flags
+//		SNAPSHOT_COMPRESS to compress the blocks or 0.
+//	@return
+//		OK, NULL_POINTER, NOT_INITIALIZED, IN_PROGRESS if the map is already being written or SYS_ERROR.
+//
+int map_snapshot_begin_aio(map_snapshot_t* snapshot, map_t* map, map_aio_t* aio, const int flags) {
+	if (snapshot == NULL || map == NULL || aio == NULL) return NULL_POINTER;
+	return snapshot_begin(snapshot, map, NULL, aio, flags);
+}
+
+//
+//	Writes the next chunk of the snapshot. The map may be changed between two steps.
+//
+//	@param snapshot
+//		the snapshot to continue.
+//	@return
+//		IN_PROGRESS if there are more chunks to write, OK if the snapshot is complete or SYS_ERROR.
+//
+int map_snapshot_step(map_snapshot_t* snapshot) {
+	if (snapshot == NULL) return NULL_POINTER;
+	if (snapshot->failed) return SYS_ERROR;
+
+	// after the last chunk the empty block ends the stream
+	if (snapshot->cursor >= snapshot->chunks) {
+		unsigned char end[SNAPSHOT_BLOCK_HEADER] = { 0 };
+		snapshot_seal(end, NULL, 0);
+		if (snapshot_write(snapshot, end, SNAPSHOT_BLOCK_HEADER) != OK) return SYS_ERROR;
+		return OK;
+	}
+
+	// take the copy if the chunk was changed, otherwise the frozen entries
+	const unsigned int c = snapshot->cursor++;
+	const unsigned int first = c * SNAPSHOT_CHUNK;
+	const unsigned int length = snapshot->capacity - first < SNAPSHOT_CHUNK ? snapshot->capacity - first : SNAPSHOT_CHUNK;
+	map_entry_t* copy = snapshot->copies[c];
+	const map_entry_t* entry = copy != NULL ? copy : snapshot->entries + first;
+	snapshot->copies[c] = NULL;
+
+	size_t used = SNAPSHOT_BLOCK_HEADER;
+	uint32_t count = 0;
+	unsigned int i;
+	for (i = 0; i < length; i++, entry++) {
+		if (entry->key == NULL) continue;
+
+		const size_t keyLength = strlen(entry->key);
+		const size_t valueLength = entry->value != NULL ? strlen(entry->value) : 0;
+		if (snapshot_grow(&snapshot->buffer, &snapshot->length, used + SNAPSHOT_RECORD + keyLength + valueLength) != OK) {
+			free(copy);
+			return SYS_ERROR;
+		}
+
+		unsigned char* p = snapshot->buffer + used;
+		map_store64(p, entry->hash);
+		map_store32(p + 8, keyLength);
+		map_store32(p + 12, entry->value != NULL ? valueLength : SNAPSHOT_NULL);
+		memcpy(p + SNAPSHOT_RECORD, entry->key, keyLength);
+		if (valueLength > 0) memcpy(p + SNAPSHOT_RECORD + keyLength, entry->value, valueLength);
+		used += SNAPSHOT_RECORD + keyLength + valueLength;
+		count++;
+	}
+	free(copy);
+
+	// chunks without valid entries are skipped, an empty block would end the stream
+	if (count == 0) return IN_PROGRESS;
+
+	// the block is stored compressed, if that makes it smaller
+	const size_t raw = used - SNAPSHOT_BLOCK_HEADER;
+	unsigned char* block = snapshot->buffer;
+	size_t stored = raw;
+	if (snapshot->flags & SNAPSHOT_COMPRESS) {
+		const size_t bound = SNAPSHOT_BLOCK_HEADER + MAP_LZ_BOUND(raw);
+		if (snapshot_grow(&snapshot->packed, &snapshot->packedLength, bound) != OK) return SYS_ERROR;
+		const size_t packed = map_lz_compress(block + SNAPSHOT_BLOCK_HEADER, raw, snapshot->packed + SNAPSHOT_BLOCK_HEADER, bound - SNAPSHOT_BLOCK_HEADER);
+		if (packed > 0 && packed < raw) {
+			block = snapshot->packed;
+			stored = packed;
+		}
+	}
+
+	map_store32(block, stored);
+	map_store32(block + 4, count);
+	map_store32(block + 8, raw);
+	map_store32(block + 12, c);
+	snapshot_seal(block, block + SNAPSHOT_BLOCK_HEADER, stored);
+	if (snapshot_write(snapshot, block, SNAPSHOT_BLOCK_HEADER + stored) != OK) return SYS_ERROR;
+	return IN_PROGRESS;
+}
+
+//
+//	Ends the snapshot, detaches it from the map and releases its memory. This can be called at any time, the stream
+//	is only complete if map_snapshot_step returned OK before.
+//
+//	@param snapshot
+//		the snapshot to end.
+//
+void map_snapshot_end(map_snapshot_t* snapshot) {
+	if (snapshot == NULL) return;
+	if (snapshot->map != NULL && snapshot->map->snapshot == snapshot) snapshot->map->snapshot = NULL;
+	snapshot->map = NULL;
+
+	unsigned int c;
+	for (c = 0; c < snapshot->chunks && snapshot->copies != NULL; c++) free(snapshot->copies[c]);
+	free(snapshot->copies);
+	if (snapshot->owned) free(snapshot->entries);
+	map_strings_release(snapshot->strings);
+	free(snapshot->buffer);
+	free(snapshot->packed);
+	snapshot->copies = NULL;
+	snapshot->entries = NULL;
+	snapshot->strings = NULL;
+	snapshot->buffer = NULL;
+	snapshot->packed = NULL;
+}
+
+//
+//	Called by the map before the slot at the provided index is changed. If the chunk of the slot was not written yet,
+//	it is copied, so that the snapshot still writes the old state.
+//
+//	@param snapshot
+//		the snapshot attached to the map.
+//	@param i
+//		the index of the slot that is going to be changed.
+//
+void map_snapshot_preserve(map_snapshot_t* snapshot, const unsigned int i) {
+	const unsigned int c = i / SNAPSHOT_CHUNK;
+	if (c < snapshot->cursor || snapshot->copies[c] != NULL) return;
+
+	const unsigned int first = c * SNAPSHOT_CHUNK;
+	const unsigned int length = snapshot->capacity - first < SNAPSHOT_CHUNK ? snapshot->capacity - first : SNAPSHOT_CHUNK;
+	map_entry_t* copy = malloc(sizeof(map_entry_t) * length);
+	if (copy == NULL) {
+		snapshot->failed = 1;
+		return;
+	}
+	memcpy(copy, snapshot->entries + first, sizeof(map_entry_t) * length);
+	snapshot->copies[c] = copy;
+}
+
+//
+//	Called by the map when it stops using the entries array of the snapshot (because it was optimized or destroyed).
+//	The snapshot takes over the array and no more chunks need to be copied.
+//
+//	@param snapshot
+//		the snapshot attached to the map.
+//
+void map_snapshot_detach(map_snapshot_t* snapshot) {
+	snapshot->map = NULL;
+	snapshot->owned = 1;
+}
+
+//
+//	Writes all key-value pairs of the map to the provided stream, compressing the blocks. Only small buffers for one
+//	block are needed, so this can as well be called in a forked child process to write the map while the parent
+//	continues to change it.
+//
+//	@param self
+//		the map to write.
+//	@param stream
+//		the stream to write to.
+//	@return
+//		OK, NULL_POINTER, NOT_INITIALIZED, IN_PROGRESS if a snapshot of the map is being written or SYS_ERROR.
+//
+int map_serialize(map_t* self, FILE* stream) {
+	map_snapshot_t snapshot;
+	int result = map_snapshot_begin(&snapshot, self, stream, SNAPSHOT_COMPRESS);
+	if (result != OK) return result;
+
+	do {
+		result = map_snapshot_step(&snapshot);
+	} while (result == IN_PROGRESS);
+
+	map_snapshot_end(&snapshot);
+	return result;
+}
+
+//
+//	Writes all key-value pairs of the map to a file like map_serialize, but without stdio: the blocks are encoded
+//	into one buffer while the other one is written (see aio.h). The file is replaced and synced to the disk.
+//
+//	@param self
+//		the map to write.
+//	@param path
+//		the path of the file.
+//	@return
+//		OK, NULL_POINTER, NOT_INITIALIZED, IN_PROGRESS if the map is already being written or SYS_ERROR.
+//
+int map_serialize_file(map_t* self, const char* path) {
+	if (self == NULL || path == NULL) return NULL_POINTER;
+	if (self->magic != MAGIC) return NOT_INITIALIZED;
+
+	map_aio_t aio;
+	if (map_aio_open(&aio, path, MAP_AIO_WRITE) != OK) return SYS_ERROR;
+
+	map_snapshot_t snapshot;
+	int result = map_snapshot_begin_aio(&snapshot, self, &aio, SNAPSHOT_COMPRESS);
+	if (result == OK) {
+		do {
+			result = map_snapshot_step(&snapshot);
+		} while (result == IN_PROGRESS);
+		map_snapshot_end(&snapshot);
+	}
+
+	const int closed = map_aio_close(&aio);
+	return result == OK ? closed : result;
+}
+
+//
+//	Decodes a block: checks the checksum, decompresses the records if needed, copies the keys and values to the
+//	strings of the block and fills the entries of the block.
+//
+//	@param block
+//		the block to decode, the result is stored in the block.
+//
+static void snapshot_decode(snapshot_block_t* block) {
+	const unsigned char* p = block->stored;
+	unsigned char* raw = NULL;
+	block->result = snapshot_check(block->head, block->stored, block->storedSize);
+	if (block->result != OK) return;
+
+	if (block->storedSize < block->rawSize) {
+		raw = malloc(block->rawSize);
+		if (raw == NULL) {
+			block->result = SYS_ERROR;
+			return;
+		}
+		if (map_lz_decompress(block->stored, block->storedSize, raw, block->rawSize) != OK) {
+			block->result = INVALID_FORMAT;
+			free(raw);
+			return;
+		}
+		p = raw;
+	}
+
+	const unsigned char* end = p + block->rawSize;
+	char* strings = block->strings;
+	uint32_t r;
+	for (r = 0; r < block->records; r++) {
+		if (end - p < SNAPSHOT_RECORD) break;
+		const int64_t hash = map_load64(p);
+		const uint32_t keyLength = map_load32(p + 8);
+		const uint32_t valueLength = map_load32(p + 12);
+		const size_t stored = valueLength != SNAPSHOT_NULL ? valueLength : 0;
+		p += SNAPSHOT_RECORD;
+		if (hash == 0 || (size_t)(end - p) < (size_t)keyLength + stored) break;
+
+		map_entry_t* entry = block->entries + r;
+		entry->key = strings;
+		memcpy(strings, p, keyLength);
+		strings[keyLength] = 0;
+		entry->hash = block->rehash != NULL ? map_hash(block->rehash, entry->key) : hash;
+		strings += keyLength + 1;
+		p += keyLength;
+
+		entry->value = NULL;
+		if (valueLength != SNAPSHOT_NULL) {
+			entry->value = strings;
+			memcpy(strings, p, stored);
+			strings[stored] = 0;
+			strings += stored + 1;
+			p += stored;
+		}
+	}
+	if (r < block->records || p != end) block->result = INVALID_FORMAT;
+	free(raw);
+}
+
+//
+//	The thread function decoding every step-th block.
+//
+//	@param argument
+//		the decoder.
+//	@return
+//		NULL.
+//
+static void* snapshot_decoder(void* argument) {
+	snapshot_decoder_t* decoder = argument;
+	unsigned int i;
+	for (i = decoder->first; i < decoder->count; i += decoder->step) snapshot_decode(decoder->blocks + i);
+	return NULL;
+}
+
+//
+//	The thread function placing the entries of a range of blocks into the range of slots of the inserter. Entries
+//	whose hash selects a slot outside of the range or that would be placed after the range are moved to the front
+//	of the entries of their block and counted as deferred.
+//
+//	@param argument
+//		the inserter.
+//	@return
+//		NULL.
+//
+static void* snapshot_inserter(void* argument) {
+	snapshot_inserter_t* inserter = argument;
+	map_entry_t* slots = inserter->slots;
+	unsigned int b;
+	for (b = inserter->first; b < inserter->last; b++) {
+		snapshot_block_t* block = inserter->blocks + b;
+		uint32_t deferred = 0;
+		uint32_t r;
+		for (r = 0; r < block->records; r++) {
+			const map_entry_t* entry = block->entries + r;
+			unsigned int i = entry->hash & inserter->mask;
+			if (i >= inserter->low && i < inserter->high) {
+				while (i < inserter->high && slots[i].hash != 0) i++;
+				if (i < inserter->high) {
+					slots[i] = *entry;
+					inserter->placed++;
+					continue;
+				}
+			}
+			block->entries[deferred++] = *entry;
+		}
+		block->deferred = deferred;
+	}
+	return NULL;
+}
+
+//
+//	Runs the provided function for all provided arguments, each on its own thread. The first one runs on the calling
+//	thread and if a thread can not be started, its function runs on the calling thread as well.
+//
+//	@param function
+//		the thread function.
+//	@param arguments
+//		the array of arguments.
+//	@param size
+//		the size of one argument.
+//	@param count
+//		the amount of arguments, at most SNAPSHOT_MAX_THREADS.
+//
+static void snapshot_parallel(void* (*function)(void*), void* arguments, const size_t size, const unsigned int count) {
+	pthread_t thread[SNAPSHOT_MAX_THREADS];
+	unsigned int t;
+	unsigned int started = 1;
+	for (t = 1; t < count; t++) {
+		if (pthread_create(thread + t, NULL, function, (char*)arguments + t * size) != 0) break;
+		started++;
+	}
+	for (t = started; t < count; t++) function((char*)arguments + t * size);
+	if (count > 0) function(arguments);
+	for (t = 1; t < started; t++) pthread_join(thread[t], NULL);
+}
+
+//
+//	Returns the amount of threads to use, as many as there are processors, but not more than SNAPSHOT_MAX_THREADS.
+//
+static unsigned int snapshot_threads() {
+	const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+	if (processors <= 1) return 1;
+	return processors < SNAPSHOT_MAX_THREADS ? (unsigned int)processors : SNAPSHOT_MAX_THREADS;
+}
+
+//
+//	Decodes the provided blocks using several threads.
+//
+//	@param blocks
+//		the blocks to decode.
+//	@param count
+//		the amount of blocks.
+//
+static void snapshot_decode_all(snapshot_block_t* blocks, const unsigned int count) {
+	unsigned int threads = snapshot_threads();
+	if (threads > count) threads = count;
+
+	snapshot_decoder_t decoder[SNAPSHOT_MAX_THREADS];
+	unsigned int t;
+	for (t = 0; t < threads; t++) {
+		decoder[t].blocks = blocks;
+		decoder[t].count = count;
+		decoder[t].first = t;
+		decoder[t].step = threads;
+	}
+	snapshot_parallel(snapshot_decoder, decoder, sizeof(snapshot_decoder_t), threads);
+}
+
+//
+//	Places the entries of the provided decoded blocks into the map using several threads. The blocks are split
+//	into ranges holding about the same amount of records and every thread gets the slots of the chunks of its
+//	range. The map must be empty at the start of loading, have the capacity the snapshot was written with and the
+//	chunks of the blocks must be ascending.
+//
+//	@param self
+//		the map to place the entries into.
+//	@param blocks
+//		the decoded blocks.
+//	@param count
+//		the amount of blocks.
+//	@param records
+//		the amount of records in all blocks.
+//
+static void snapshot_insert_all(map_t* self, snapshot_block_t* blocks, const unsigned int count, const uint64_t records) {
+	unsigned int threads = snapshot_threads();
+	if (threads > count) threads = count;
+
+	snapshot_inserter_t inserter[SNAPSHOT_MAX_THREADS];
+	unsigned int t = 0;
+	unsigned int b;
+	uint64_t sum = 0;
+	inserter[0].first = 0;
+	inserter[0].low = blocks[0].chunk * SNAPSHOT_CHUNK;
+	for (b = 0; b < count; b++) {
+		// a new range starts once the current one holds its share of the records
+		if (b > 0 && t + 1 < threads && sum * threads >= records * (t + 1)) {
+			inserter[t].last = b;
+			inserter[t].high = blocks[b].chunk * SNAPSHOT_CHUNK;
+			t++;
+			inserter[t].first = b;
+			inserter[t].low = inserter[t - 1].high;
+		}
+		sum += blocks[b].records;
+	}
+	inserter[t].last = count;
+	inserter[t].high = (blocks[count - 1].chunk + 1) * SNAPSHOT_CHUNK;
+	if (inserter[t].high > self->capacity) inserter[t].high = self->capacity;
+	threads = t + 1;
+
+	for (t = 0; t < threads; t++) {
+		inserter[t].slots = self->entries;
+		inserter[t].mask = self->capacity - 1;
+		inserter[t].blocks = blocks;
+		inserter[t].placed = 0;
+	}
+	snapshot_parallel(snapshot_inserter, inserter, sizeof(snapshot_inserter_t), threads);
+
+	for (t = 0; t < threads; t++) {
+		self->size += inserter[t].placed;
+		self->allocated += inserter[t].placed;
+	}
+}
+
+//
+//	Checks the header of a snapshot stream.
+//
+//	@param header
+//		the header.
+//	@return
+//		OK, UNSUPPORTED_VERSION if the stream was written by another version or INVALID_FORMAT.
+//
+static int snapshot_header(const unsigned char* header) {
+	if (map_load64(header) != SNAPSHOT_MAGIC) return INVALID_FORMAT;
+	if (map_crc32c(0, header, 40) != map_load32(header + 40)) return INVALID_FORMAT;
+	if (map_load32(header + 8) != SNAPSHOT_VERSION) return UNSUPPORTED_VERSION;
+
+	const uint64_t count = map_load64(header + 16);
+	const uint64_t capacity = map_load64(header + 24);
+	if (count > 0x7FFFFFFF || count > capacity || capacity > 0x80000000 || (capacity & (capacity - 1)) != 0) {
+		return INVALID_FORMAT;
+	}
+	return OK;
+}
+
+//
+//	Checks the sizes in the header of a block, but not its checksum.
+//
+//	@param head
+//		the header of the block.
+//	@return
+//		OK or INVALID_FORMAT.
+//
+static int snapshot_block(const unsigned char* head) {
+	const uint32_t storedSize = map_load32(head);
+	const uint32_t records = map_load32(head + 4);
+	const uint32_t rawSize = map_load32(head + 8);
+	if (storedSize == 0 && records == 0) return rawSize == 0 ? OK : INVALID_FORMAT;
+	if (rawSize > SNAPSHOT_MAX_BLOCK || storedSize > rawSize || records == 0) return INVALID_FORMAT;
+	return (uint64_t)records * SNAPSHOT_RECORD > rawSize ? INVALID_FORMAT : OK;
+}
+
+//
+//	Reads a snapshot from a stream or a file into the map.
+//
+static int snapshot_load(map_t* self, FILE* stream, map_aio_t* aio) {
+	unsigned char header[SNAPSHOT_HEADER];
+	int status = snapshot_read(stream, aio, header, SNAPSHOT_HEADER);
+	if (status == OK) status = snapshot_header(header);
+	if (status != OK) return status;
+	const uint64_t count = map_load64(header + 16);
+	const uint64_t capacity = map_load64(header + 24);
+
+	// the hashes written by a map with another hash function are calculated again while decoding, unless the map
+	// gets its hashes from the caller
+	const map_t* rehash = map_load64(header + 32) != map_hash_id(self) ? self : NULL;
+	if (rehash != NULL && self->hashKind == MAP_HASH_EXTERNAL) return ERR_NOT_IMPLEMENTED;
+
+	// an empty map gets the capacity of the snapshot, so the threads can place the entries into the chunks they
+	// were written from, unless that capacity is way too large or the entries get other hashes
+	int partitioned = 0;
+	if (self->size == 0 && self->allocated == 0 && self->snapshot == NULL && rehash == NULL
+			&& capacity <= 4 * (count + SNAPSHOT_CHUNK)) {
+		if (map_rebuild(self, (unsigned int)capacity) != OK) return SYS_ERROR;
+		partitioned = self->capacity == capacity;
+	}
+
+	// make space for all keys at once, so the map is not optimized while loading
+	if (!partitioned && map_reserve(self, (unsigned int)count) != OK) return SYS_ERROR;
+
+	snapshot_block_t blocks[SNAPSHOT_BATCH_BLOCKS];
+	uint64_t loaded = 0;
+	int64_t previous = -1;
+	int result = OK;
+	int ended = 0;
+	while (result == OK && !ended) {
+		// read a batch of blocks
+		unsigned int n = 0;
+		size_t bytes = 0;
+		uint64_t records = 0;
+		while (n < SNAPSHOT_BATCH_BLOCKS && bytes < SNAPSHOT_BATCH_BYTES) {
+			snapshot_block_t* block = blocks + n;
+			unsigned char* head = block->head;
+			result = snapshot_read(stream, aio, head, SNAPSHOT_BLOCK_HEADER);
+			if (result != OK) break;
+			block->storedSize = map_load32(head);
+			block->records = map_load32(head + 4);
+			block->rawSize = map_load32(head + 8);
+			block->chunk = map_load32(head + 12);
+			block->rehash = rehash;
+			if (snapshot_block(head) != OK) { result = INVALID_FORMAT; break; }
+			if (block->storedSize == 0 && block->records == 0) {
+				if (snapshot_check(head, NULL, 0) != OK) result = INVALID_FORMAT;
+				ended = 1;
+				break;
+			}
+
+			// the threads can only place the entries if the chunks are ascending and inside of the map
+			if ((int64_t)block->chunk <= previous || (uint64_t)block->chunk * SNAPSHOT_CHUNK >= capacity) partitioned = 0;
+			previous = block->chunk;
+
+			// the strings need less memory than the records, because a record header is larger than two terminators
+			block->stored = malloc(block->storedSize);
+			block->entries = malloc(sizeof(map_entry_t) * block->records);
+			block->strings = map_alloc(self, block->rawSize);
+			block->deferred = block->records;
+			n++;
+			if (block->stored == NULL || block->entries == NULL || block->strings == NULL) { result = SYS_ERROR; break; }
+			result = snapshot_read(stream, aio, block->stored, block->storedSize);
+			if (result != OK) break;
+			bytes += block->storedSize;
+			records += block->records;
+		}
+
+		if (result == OK && n > 0) {
+			snapshot_decode_all(blocks, n);
+
+			unsigned int b;
+			for (b = 0; b < n && result == OK; b++) result = blocks[b].result;
+			if (result == OK && partitioned) snapshot_insert_all(self, blocks, n, records);
+		}
+
+		// add the entries that were not placed by the threads
+		unsigned int b;
+		for (b = 0; b < n; b++) {
+			snapshot_block_t* block = blocks + b;
+			loaded += block->records;
+
+			uint32_t r;
+			for (r = 0; r < block->deferred && result == OK; r++) {
+				const map_entry_t* entry = block->entries + r;
+
+				// a stream may hold more keys than announced, then the map must grow
+				int set = map_set(self, entry->key, entry->value, entry->hash, 1);
+				if (set == REQUIRES_OPTIMIZATION) {
+					partitioned = 0;
+					if (map_optimize(self) != OK) { result = SYS_ERROR; break; }
+					set = map_set(self, entry->key, entry->value, entry->hash, 1);
+				}
+				if (set != OK) result = SYS_ERROR;
+			}
+			free(block->stored);
+			free(block->entries);
+		}
+	}
+
+	if (result == OK && loaded != count) result = INVALID_FORMAT;
+
+	// the threads placed their entries without map_set, so the filter lacks them
+	if (self->filter != NULL && map_filter_fill(self) != OK && result == OK) result = SYS_ERROR;
+	return result;
+}
+
+//
+//	Reads key-value pairs written by map_serialize from the provided stream into the map. Existing keys are replaced,
+//	the loaded keys and values are owned by the map. The blocks are read in batches and every batch is decoded by
+//	several threads at once. If the map is empty, the threads place the entries as well, otherwise the entries are
+//	added by the calling thread.
+//
+//	@param self
+//		the initialized map to read into.
+//	@param stream
+//		the stream to read from.
+//	@return
+//		OK, NULL_POINTER, NOT_INITIALIZED, UNSUPPORTED_VERSION, INVALID_FORMAT if the stream is not a complete and
+//		intact snapshot, ERR_NOT_IMPLEMENTED if the map has external hashes and the stream other ones or SYS_ERROR.
+//
+int map_deserialize(map_t* self, FILE* stream) {
+	if (self == NULL || stream == NULL) return NULL_POINTER;
+	if (self->magic != MAGIC) return NOT_INITIALIZED;
+	return snapshot_load(self, stream, NULL);
+}
+
+//
+//	Reads a snapshot file written by map_serialize or map_serialize_file into the map like map_deserialize, but
+//	without stdio: the next part of the file is read while the blocks before it are decoded (see aio.h).
+//
+//	@param self
+//		the initialized map to read into.
+//	@param path
+//		the path of the file.
+//	@return
+//		OK, NULL_POINTER, NOT_INITIALIZED, UNSUPPORTED_VERSION, INVALID_FORMAT if the file is not a complete and
+//		intact snapshot, ERR_NOT_IMPLEMENTED if the map has external hashes and the file other ones or SYS_ERROR.
+//
+int map_deserialize_file(map_t* self, const char* path) {
+	if (self == NULL || path == NULL) return NULL_POINTER;
+	if (self->magic != MAGIC) return NOT_INITIALIZED;
+
+	map_aio_t aio;
+	if (map_aio_open(&aio, path, MAP_AIO_READ) != OK) return SYS_ERROR;
+	const int result = snapshot_load(self, NULL, &aio);
+	map_aio_close(&aio);
+	return result;
+}
+
+//
+//	An image is the entries array of the map as it is in memory, so that loading it needs no hashing and no probing,
+//	unless the map loading it has another hash function or key than the one written to the header.
+//	The keys and values are replaced by their offset plus one in the string section that follows the entries, zero
+//	stands for NULL. The deleted slots are kept, so the slots of the loaded map are exactly the same. Because the
+//	entries are stored in the byte order and layout of the machine, an image can only be loaded on machines with the
+//	same layout.
+//
+//	header:	uint64 magic, uint32 version, uint32 size of map_entry_t, uint64 0x0102030405060708 in machine order,
+//			uint64 capacity, uint32 size, uint32 allocated, uint64 size of the string section,
+//			uint64 hash function (see map_hash_id), uint32 checksum, uint32 reserved
+//	entries: capacity times map_entry_t
+//	strings: the zero terminated keys and values
+//	trailer: uint32 checksum of the entries, uint32 checksum of the strings
+//
+
+
+//
+//	Writes an image of the entries array of the map to the provided stream. The map must not be changed while this
+//	runs, a forked child process can write the image of the map while the parent continues to change it.
+//
+//	@param self
+//		the map to write.
+//	@param stream
+//		the stream to write to.
+//	@return
+//		OK, NULL_POINTER, NOT_INITIALIZED or SYS_ERROR.
+//
+int map_serialize_image(map_t* self, FILE* stream) {
+	if (self == NULL || stream == NULL) return NULL_POINTER;
+	if (self->magic != MAGIC) return NOT_INITIALIZED;
+
+	// the first pass calculates the size of the string section
+	uint64_t strings = 0;
+	unsigned int i;
+	for (i = 0; i < self->capacity; i++) {
+		const map_entry_t* entry = self->entries + i;
+		if (entry->key == NULL) continue;
+		strings += strlen(entry->key) + 1;
+		if (entry->value != NULL) strings += strlen(entry->value) + 1;
+	}
+
+	unsigned char header[IMAGE_HEADER];
+	const uint64_t order = 0x0102030405060708;
+	map_store64(header, IMAGE_MAGIC);
+	map_store32(header + 8, IMAGE_VERSION);
+	map_store32(header + 12, sizeof(map_entry_t));
+	memcpy(header + 16, &order, sizeof(order));
+	map_store64(header + 24, self->capacity);
+	map_store32(header + 32, self->size);
+	map_store32(header + 36, self->allocated);
+	map_store64(header + 40, strings);
+	map_store64(header + 48, map_hash_id(self));
+	map_store32(header + 60, 0);
+	map_store32(header + 56, map_crc32c(0, header, 56));
+	if (fwrite(header, IMAGE_HEADER, 1, stream) != 1) return SYS_ERROR;
+
+	// the second pass writes the entries with the pointers replaced by offsets
+	map_entry_t chunk[IMAGE_CHUNK];
+	uint64_t offset = 0;
+	uint32_t entriesChecksum = 0;
+	uint32_t stringsChecksum = 0;
+	for (i = 0; i < self->capacity; i += IMAGE_CHUNK) {
+		const unsigned int length = self->capacity - i < IMAGE_CHUNK ? self->capacity - i : IMAGE_CHUNK;
+		unsigned int j;
+		for (j = 0; j < length; j++) {
+			const map_entry_t* entry = self->entries + i + j;
+			chunk[j].hash = entry->hash;
+			chunk[j].key = NULL;
+			chunk[j].value = NULL;
+			if (entry->key == NULL) continue;
+
+			chunk[j].key = (const char*)(uintptr_t)(offset + 1);
+			offset += strlen(entry->key) + 1;
+			if (entry->value != NULL) {
+				chunk[j].value = (const char*)(uintptr_t)(offset + 1);
+				offset += strlen(entry->value) + 1;
+			}
+		}
+		if (fwrite(chunk, sizeof(map_entry_t), length, stream) != length) return SYS_ERROR;
+		entriesChecksum = map_crc32c(entriesChecksum, chunk, sizeof(map_entry_t) * length);
+	}
+
+	// the third pass writes the strings in the same order
+	for (i = 0; i < self->capacity; i++) {
+		const map_entry_t* entry = self->entries + i;
+		if (entry->key == NULL) continue;
+		const size_t keyLength = strlen(entry->key) + 1;
+		if (fwrite(entry->key, keyLength, 1, stream) != 1) return SYS_ERROR;
+		stringsChecksum = map_crc32c(stringsChecksum, entry->key, keyLength);
+		if (entry->value == NULL) continue;
+		const size_t valueLength = strlen(entry->value) + 1;
+		if (fwrite(entry->value, valueLength, 1, stream) != 1) return SYS_ERROR;
+		stringsChecksum = map_crc32c(stringsChecksum, entry->value, valueLength);
+	}
+
+	unsigned char trailer[IMAGE_TRAILER];
+	map_store32(trailer, entriesChecksum);
+	map_store32(trailer + 4, stringsChecksum);
+	return fwrite(trailer, IMAGE_TRAILER, 1, stream) == 1 ? OK : SYS_ERROR;
+}
+
+//
+//	Checks the header of an image.
+//
+//	@param header
+//		the header.
+//	@return
+//		OK, UNSUPPORTED_VERSION if the image was written by another version or INVALID_FORMAT.
+//
+static int image_header(const unsigned char* header) {
+	if (map_load64(header) != IMAGE_MAGIC) return INVALID_FORMAT;
+	if (map_crc32c(0, header, 56) != map_load32(header + 56)) return INVALID_FORMAT;
+	if (map_load32(header + 8) != IMAGE_VERSION) return UNSUPPORTED_VERSION;
+
+	uint64_t order;
+	memcpy(&order, header + 16, sizeof(order));
+	if (map_load32(header + 12) != sizeof(map_entry_t) || order != 0x0102030405060708) return INVALID_FORMAT;
+
+	const uint64_t capacity = map_load64(header + 24);
+	const uint32_t size = map_load32(header + 32);
+	const uint32_t allocated = map_load32(header + 36);
+	const uint64_t strings = map_load64(header + 40);
+	if (capacity < 1 || capacity > 0x80000000 || (capacity & (capacity - 1)) != 0) return INVALID_FORMAT;
+	if (size > allocated || allocated > capacity || strings > SIZE_MAX / 2) return INVALID_FORMAT;
+	return OK;
+}
+
+//
+//	Replaces the content of the map with an image written by map_serialize_image. The entries are read directly
+//	into the new entries array and the strings into memory owned by the map, then a single pass turns the offsets
+//	back into pointers.
+//
+//	@param self
+//		the initialized map to load the image into.
+//	@param stream
+//		the stream to read from.
+//	@return
+//		OK, NULL_POINTER, NOT_INITIALIZED, IN_PROGRESS if a snapshot of the map is being written,
+//		UNSUPPORTED_VERSION, INVALID_FORMAT if the stream is not a complete and intact image of this machine's layout,
+//		ERR_NOT_IMPLEMENTED if the map has external hashes and the image other ones or SYS_ERROR.
+//
+int map_deserialize_image(map_t* self, FILE* stream) {
+	if (self == NULL || stream == NULL) return NULL_POINTER;
+	if (self->magic != MAGIC) return NOT_INITIALIZED;
+	if (self->snapshot != NULL) return IN_PROGRESS;
+
+	unsigned char header[IMAGE_HEADER];
+	if (fread(header, IMAGE_HEADER, 1, stream) != 1) return INVALID_FORMAT;
+	const int status = image_header(header);
+	if (status != OK) return status;
+
+	const uint64_t capacity = map_load64(header + 24);
+	const uint32_t size = map_load32(header + 32);
+	const uint32_t allocated = map_load32(header + 36);
+	const uint64_t strings = map_load64(header + 40);
+
+	map_entry_t* entries = malloc(sizeof(map_entry_t) * capacity);
+	char* base = strings > 0 ? map_alloc(self, strings) : NULL;
+	if (entries == NULL || (strings > 0 && base == NULL)) {
+		free(entries);
+		return SYS_ERROR;
+	}
+	unsigned char trailer[IMAGE_TRAILER];
+	if (fread(entries, sizeof(map_entry_t), capacity, stream) != capacity
+			|| (strings > 0 && fread(base, strings, 1, stream) != 1) || fread(trailer, IMAGE_TRAILER, 1, stream) != 1) {
+		free(entries);
+		return INVALID_FORMAT;
+	}
+
+	// the section ends with a terminator, so every offset inside of it is a terminated string
+	int result = strings == 0 || base[strings - 1] == 0 ? OK : INVALID_FORMAT;
+	if (map_crc32c(0, entries, sizeof(map_entry_t) * capacity) != map_load32(trailer)) result = INVALID_FORMAT;
+	if (map_crc32c(0, base, strings) != map_load32(trailer + 4)) result = INVALID_FORMAT;
+	uint64_t i;
+	uint32_t valid = 0;
+	uint32_t used = 0;
+	for (i = 0; i < capacity && result == OK; i++) {
+		map_entry_t* entry = entries + i;
+		const uintptr_t key = (uintptr_t)entry->key;
+		const uintptr_t value = (uintptr_t)entry->value;
+		if (key > strings || value > strings || (key == 0 && value != 0)) result = INVALID_FORMAT;
+		entry->key = key != 0 ? base + key - 1 : NULL;
+		entry->value = value != 0 ? base + value - 1 : NULL;
+		if (entry->hash != 0) used++;
+		if (key != 0) {
+			if (entry->hash == 0) result = INVALID_FORMAT;
+			valid++;
+		}
+	}
+	if (result == OK && (valid != size || used != allocated)) result = INVALID_FORMAT;
+	if (result == OK && self->hashKind == MAP_HASH_EXTERNAL && map_load64(header + 48) != map_hash_id(self)) {
+		result = ERR_NOT_IMPLEMENTED;
+	}
+	if (result != OK) {
+		free(entries);
+		return result;
+	}
+
+	free(self->entries);
+	self->entries = entries;
+	self->capacity = (unsigned int)capacity;
+	self->size = size;
+	self->allocated = allocated;
+	if (map_load64(header + 48) == map_hash_id(self)) return self->filter != NULL ? map_filter_fill(self) : OK;
+
+	// the image was written by a map with another hash function, the keys get their hashes in this map and are
+	// placed again
+	return map_rehash(self);
+}
+
+//
+//	Reads the provided amount of bytes from the stream in pieces and calculates their checksum.
+//
+//	@param stream
+//		the stream to read from.
+//	@param buffer
+//		a buffer of VALIDATE_BUFFER bytes.
+//	@param length
+//		the amount of bytes to read.
+//	@param checksum
+//		the checksum of the previous bytes, is updated.
+//	@return
+//		OK or INVALID_FORMAT if the stream ended before.
+//
+static int validate_read(FILE* stream, unsigned char* buffer, uint64_t length, uint32_t* checksum) {
+	while (length > 0) {
+		const size_t piece = length < VALIDATE_BUFFER ? (size_t)length : VALIDATE_BUFFER;
+		if (fread(buffer, piece, 1, stream) != 1) return INVALID_FORMAT;
+		*checksum = map_crc32c(*checksum, buffer, piece);
+		length -= piece;
+	}
+	return OK;
+}
+
+//
+//	Checks a snapshot stream after its magic: the header, the checksums of all blocks and the amount of entries.
+//
+static int validate_snapshot(FILE* stream, unsigned char* header, unsigned char* buffer) {
+	if (fread(header + 8, SNAPSHOT_HEADER - 8, 1, stream) != 1) return INVALID_FORMAT;
+	const int status = snapshot_header(header);
+	if (status != OK) return status;
+
+	uint64_t records = 0;
+	for (;;) {
+		unsigned char head[SNAPSHOT_BLOCK_HEADER];
+		if (fread(head, SNAPSHOT_BLOCK_HEADER, 1, stream) != 1 || snapshot_block(head) != OK) return INVALID_FORMAT;
+
+		uint32_t checksum = map_crc32c(0, head, SNAPSHOT_CHECKSUM);
+		if (validate_read(stream, buffer, map_load32(head), &checksum) != OK) return INVALID_FORMAT;
+		if (checksum != map_load32(head + SNAPSHOT_CHECKSUM)) return INVALID_FORMAT;
+		if (map_load32(head + 4) == 0) break;
+		records += map_load32(head + 4);
+	}
+	return records == map_load64(header + 16) ? OK : INVALID_FORMAT;
+}
+
+//
+//	Checks an image after its magic: the header and the checksums of the entries and the strings.
+//
+static int validate_image(FILE* stream, unsigned char* header, unsigned char* buffer) {
+	if (fread(header + 8, IMAGE_HEADER - 8, 1, stream) != 1) return INVALID_FORMAT;
+	const int status = image_header(header);
+	if (status != OK) return status;
+
+	uint32_t entries = 0;
+	uint32_t strings = 0;
+	unsigned char trailer[IMAGE_TRAILER];
+	if (validate_read(stream, buffer, sizeof(map_entry_t) * map_load64(header + 24), &entries) != OK) return INVALID_FORMAT;
+	if (validate_read(stream, buffer, map_load64(header + 40), &strings) != OK) return INVALID_FORMAT;
+	if (fread(trailer, IMAGE_TRAILER, 1, stream) != 1) return INVALID_FORMAT;
+	return entries == map_load32(trailer) && strings == map_load32(trailer + 4) ? OK : INVALID_FORMAT;
+}
+
+//
+//	Checks a snapshot written by map_serialize or an image written by map_serialize_image without loading it. Only
+//	the checksums are calculated (nothing is decompressed or hashed) and only one buffer is used, so this runs
+//	at the speed of the disk.
+//
+//	@param stream
+//		the stream to check.
+//	@return
+//		OK, NULL_POINTER, UNSUPPORTED_VERSION, INVALID_FORMAT if the stream is corrupted or truncated or SYS_ERROR.
+//
+int map_validate(FILE* stream) {
+	if (stream == NULL) return NULL_POINTER;
+
+	unsigned char header[SNAPSHOT_HEADER > IMAGE_HEADER ? SNAPSHOT_HEADER : IMAGE_HEADER];
+	if (fread(header, 8, 1, stream) != 1) return INVALID_FORMAT;
+
+	unsigned char* buffer = malloc(VALIDATE_BUFFER);
+	if (buffer == NULL) return SYS_ERROR;
+
+	int result = INVALID_FORMAT;
+	if (map_load64(header) == SNAPSHOT_MAGIC) result = validate_snapshot(stream, header, buffer);
+	if (map_load64(header) == IMAGE_MAGIC) result = validate_image(stream, header, buffer);
+	free(buffer);
+	return result;
+}
@@ -0,0 +1,103 @@
+#ifndef __A1_SNAPSHOT_H__
+#define __A1_SNAPSHOT_H__
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "aio.h"
+#include "map.h"
+
+//
+//	A snapshot writes the map in the format of map_serialize, but block by block, so that the map stays writable in
+//	between the steps. It captures the map as it was when the snapshot began: the entries array is frozen and every
+//	chunk of slots that is about to be changed before it was written is copied first. If the map is optimized in the
+//	meantime the snapshot simply keeps the old entries array, because the map does not touch it anymore.
+//
+//	The memory overhead is bounded by the chunks that are changed while the snapshot runs, chunks that are written
+//	already are never copied. The keys and values are not copied, so they must stay valid until the snapshot ended,
+//	even if they are removed from the map in the meantime.
+//
+//	The map is not thread safe, so if other threads are writing it, they must hold the same lock that is held while
+//	calling map_snapshot_step. The lock is then only held for one chunk instead of the whole dump. Alternatively the
+//	process can fork and call map_serialize in the child, the operating system then provides the copy-on-write view.
+//
+//	Instead of a stream, a snapshot can be written to a file opened with map_aio_open (see aio.h), which bypasses
+//	stdio and overlaps encoding the next blocks with writing the previous ones. map_serialize_file and
+//	map_deserialize_file do that for a whole snapshot.
+//
+
+// the amount of slots written as one block, must be 2^n
+#define SNAPSHOT_CHUNK (1 << 10)
+
+// identifies a snapshot stream, "KVAMAP" followed by the format version
+#define SNAPSHOT_MAGIC 0x4B56414D41500000L
+#define SNAPSHOT_VERSION 5
+
+// the flags of a snapshot
+#define SNAPSHOT_COMPRESS 1
+
+// the length of a value that is NULL
+#define SNAPSHOT_NULL 0xFFFFFFFF
+
+// identifies an image of the entries array, "KVAIMG" followed by the format version
+#define IMAGE_MAGIC 0x4B5641494D470000L
+#define IMAGE_VERSION 3
+
+// the state of a snapshot
+typedef struct map_snapshot_s {
+	// the map being written or NULL if the map does not use the entries array anymore
+	map_t* map;
+
+	// the frozen entries array of the map
+	map_entry_t* entries;
+
+	// the amount of slots in the frozen entries array
+	unsigned int capacity;
+
+	// the amount of chunks and the next chunk to be written
+	unsigned int chunks;
+	unsigned int cursor;
+
+	// the copies of the chunks changed before they were written, NULL for unchanged chunks
+	map_entry_t** copies;
+
+	// if not zero, the entries array was handed over by the map and must be released by the snapshot
+	int owned;
+
+	// the reference to the keys and values allocated by the map, they outlive the map until the snapshot ends
+	void* strings;
+
+	// if not zero, a chunk could not be copied and the snapshot is not consistent anymore
+	int failed;
+
+	// the stream or the file to write to and the flags of the snapshot
+	FILE* stream;
+	map_aio_t* aio;
+	int flags;
+
+	// the buffer in which a block is encoded and the buffer in which it is compressed
+	unsigned char* buffer;
+	size_t length;
+	unsigned char* packed;
+	size_t packedLength;
+} map_snapshot_t;
+
+int map_snapshot_begin(map_snapshot_t*, map_t*, FILE*, int);
+int map_snapshot_begin_aio(map_snapshot_t*, map_t*, map_aio_t*, int);
+int map_snapshot_step(map_snapshot_t*);
+void map_snapshot_end(map_snapshot_t*);
+
+// Snapshots written to and read from a file without stdio.
+int map_serialize_file(map_t*, const char*);
+int map_deserialize_file(map_t*, const char*);
+
+// Images of the entries array, loaded without hashing or probing.
+int map_serialize_image(map_t*, FILE*);
+int map_deserialize_image(map_t*, FILE*);
+
+// Checks a snapshot or an image without loading it.
+int map_validate(FILE*);
+
+// Hooks used by the map while a snapshot is attached.
+void map_snapshot_preserve(map_snapshot_t*, unsigned int);
+void map_snapshot_detach(map_snapshot_t*);
+#endif
@@ -0,0 +1,184 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "map.h"
+#include "snapshot.h"
+#include "aio.h"
+#include "check.h"
+
+//
+//	Test of the file I/O of the snapshots, run by "make check". It is built twice, the second time with
+//	MAP_AIO_BLOCKING and its own copy of aio.c, so both the io_uring (where the kernel provides it) and the
+//	blocking transfers are tested. The first build has the test hook of aio.c (AIO_TESTING). The files are written
+//	to a new directory in /tmp, which is removed at the end.
+//
+
+#ifdef MAP_AIO_BLOCKING
+#define NAME "aio_blocking_test"
+#else
+#define NAME "aio_test"
+#endif
+
+// the amount of keys of the map written to a file, their values make the snapshot larger than both buffers
+#define KEYS 200000
+#define VALUE 64
+
+static uint64_t state = 0x9E3779B97F4A7C15ULL;
+
+// returns the next pseudo random number (xorshift64)
+static uint64_t next() {
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+static long size(const char* path) {
+	struct stat info;
+	return stat(path, &info) == 0 ? (long)info.st_size : -1;
+}
+
+//
+//	Writes the bytes to a file in pieces of changing length and reads them back in pieces of other lengths. Reading
+//	beyond the end fails.
+//
+static void roundtrip(const char* path, const unsigned char* bytes, const size_t length) {
+	map_aio_t aio;
+	CHECK(map_aio_open(&aio, path, MAP_AIO_WRITE) == OK);
+#ifdef MAP_AIO_BLOCKING
+	CHECK(aio.ring == NULL);
+#endif
+	size_t done = 0;
+	size_t piece = 1;
+	while (done < length) {
+		if (piece > length - done) piece = length - done;
+		CHECK(map_aio_write(&aio, bytes + done, piece) == OK);
+		done += piece;
+		piece = piece * 3 + 1;
+	}
+	CHECK(map_aio_close(&aio) == OK);
+	CHECK(size(path) == (long)length);
+
+	unsigned char* read = malloc(length + 1);
+	CHECK(read != NULL);
+	if (read == NULL) return;
+	CHECK(map_aio_open(&aio, path, MAP_AIO_READ) == OK);
+	done = 0;
+	piece = 4093;
+	while (done < length) {
+		if (piece > length - done) piece = length - done;
+		CHECK(map_aio_read(&aio, read + done, piece) == OK);
+		done += piece;
+		piece = piece * 2 + 7;
+	}
+	CHECK(memcmp(read, bytes, length) == 0);
+	CHECK(map_aio_read(&aio, read, 1) == INVALID_FORMAT);
+	CHECK(map_aio_close(&aio) == OK);
+	free(read);
+}
+
+#ifdef AIO_TESTING
+// a ring that does not return its completions anymore
+static int failing(struct map_aio_ring_s* ring, uint64_t* tag, int* result) {
+	(void)ring;
+	(void)tag;
+	(void)result;
+	return SYS_ERROR;
+}
+#endif
+
+int main() {
+	char directory[] = "/tmp/aio_test.XXXXXX";
+	CHECK(mkdtemp(directory) != NULL);
+	char path[64];
+	sprintf(path, "%s/file", directory);
+
+	// files that are smaller than a block, exactly both buffers and larger than both buffers, but not block aligned
+	const size_t largest = 2 * MAP_AIO_BUFFER + MAP_AIO_ALIGNMENT + 123;
+	unsigned char* bytes = malloc(largest);
+	CHECK(bytes != NULL);
+	if (bytes != NULL) {
+		size_t i;
+		for (i = 0; i < largest; i++) bytes[i] = (unsigned char)next();
+		roundtrip(path, bytes, 100);
+		roundtrip(path, bytes, 2 * MAP_AIO_BUFFER);
+		roundtrip(path, bytes, largest);
+		roundtrip(path, bytes, 0);
+		free(bytes);
+	}
+
+	// a map whose snapshot is larger than both buffers is written and read back, the file is a snapshot as written
+	// by map_serialize
+	char* strings = malloc((size_t)KEYS * (16 + VALUE + 1));
+	CHECK(strings != NULL);
+	if (strings != NULL) {
+		map_t map;
+		map_init(&map);
+		char* p = strings;
+		int i;
+		for (i = 0; i < KEYS; i++) {
+			char* key = p;
+			p += sprintf(key, "key%d", i) + 1;
+			char* value = p;
+			int j;
+			for (j = 0; j < VALUE; j++) value[j] = "0123456789abcdef"[next() & 15];
+			value[i % VALUE] = 0;
+			p += VALUE + 1;
+			CHECK(map_put(&map, key, i % 7 ? value : NULL) == OK);
+		}
+		CHECK(map_serialize_file(&map, path) == OK);
+		CHECK(size(path) > 2 * MAP_AIO_BUFFER && size(path) % MAP_AIO_ALIGNMENT != 0);
+
+		map_t loaded;
+		map_init(&loaded);
+		CHECK(map_deserialize_file(&loaded, path) == OK);
+		CHECK(map_size(&loaded) == KEYS);
+		map_t streamed;
+		map_init(&streamed);
+		FILE* stream = fopen(path, "rb");
+		CHECK(stream != NULL && map_deserialize(&streamed, stream) == OK);
+		if (stream != NULL) fclose(stream);
+		CHECK(map_size(&streamed) == KEYS);
+
+#ifdef AIO_TESTING
+		// the reads of both buffers are in flight when their completions cannot be taken, the kernel may still write
+		// into the buffers, so they are not released
+		int (*reap)(struct map_aio_ring_s*, uint64_t*, int*) = map_aio_reap;
+		map_aio_reap = failing;
+		map_aio_t aio;
+		CHECK(map_aio_open(&aio, path, MAP_AIO_READ) == OK);
+		if (aio.ring != NULL) {
+			char byte;
+			CHECK(aio.lost && map_aio_read(&aio, &byte, 1) == SYS_ERROR);
+			CHECK(map_aio_close(&aio) == SYS_ERROR);
+			CHECK(aio.buffers[0] != NULL && aio.buffers[1] != NULL);
+		} else {
+			CHECK(!aio.lost && map_aio_close(&aio) == OK && aio.buffers[0] == NULL);
+		}
+		map_aio_reap = reap;
+#endif
+
+		p = strings;
+		for (i = 0; i < KEYS; i++) {
+			const char* key = p;
+			p += strlen(key) + 1;
+			const char* value = i % 7 ? p : NULL;
+			p += VALUE + 1;
+			const char* a = map_get(&loaded, key);
+			const char* b = map_get(&streamed, key);
+			CHECK(value == NULL ? a == NULL && b == NULL : a != NULL && b != NULL && strcmp(a, value) == 0 && strcmp(b, value) == 0);
+		}
+		map_destroy(&streamed);
+		map_destroy(&loaded);
+		map_destroy(&map);
+		free(strings);
+	}
+
+	unlink(path);
+	rmdir(directory);
+	if (failures == 0) printf(NAME ": ok\n");
+	return failures;
+}
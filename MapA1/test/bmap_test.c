@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bmap.h"
+#include "check.h"
+
+//
+//	Test of the blob map, run by "make check".
+//
+
+// a value that fits into the slot
+typedef struct {
+	int x, y, z;
+} point_t;
+
+int main() {
+	static char keys[20000][16];
+	static char large[100000];
+	bmap_t m;
+	bmap_value_t view;
+	bmap_init(&m);
+	int i;
+	for (i = 0; i < (int)sizeof(large); i++) large[i] = (char)i;
+
+	// even keys get a 12 byte struct stored in the slot, odd keys a copy of a part of the large array
+	for (i = 0; i < 20000; i++) {
+		sprintf(keys[i], "key%d", i);
+		if (i % 2 == 0) {
+			const point_t point = { i, -i, i * 3 };
+			CHECK(bmap_put(&m, keys[i], &point, sizeof(point)) == OK);
+		} else {
+			CHECK(bmap_put(&m, keys[i], large + i, 13 + i % 1000) == OK);
+		}
+	}
+	CHECK(bmap_put(&m, "key4", large, 4) == KEY_EXISTS);
+	CHECK(bmap_put(&m, "empty", NULL, 0) == OK);
+	CHECK(bmap_put(&m, "huge", large, sizeof(large)) == OK);
+	CHECK(bmap_put(&m, "null", NULL, 1) == NULL_POINTER);
+	CHECK(bmap_size(&m) == 20002);
+
+	// the values of the removed keys are gone, the others are unchanged after the map was rebuilt
+	for (i = 0; i < 20000; i += 3) CHECK(bmap_remove(&m, keys[i]) == OK);
+	CHECK(bmap_remove(&m, "key0") == NO_KEY_EXISTS);
+	for (i = 0; i < 20000; i++) {
+		const int found = bmap_get(&m, keys[i], &view);
+		if (i % 3 == 0) {
+			CHECK(found == NO_KEY_EXISTS);
+		} else if (i % 2 == 0) {
+			point_t point;
+			CHECK(found == OK && view.length == sizeof(point));
+			memcpy(&point, view.data, sizeof(point));
+			CHECK(point.x == i && point.y == -i && point.z == i * 3);
+		} else {
+			CHECK(found == OK && view.length == (size_t)(13 + i % 1000));
+			CHECK(memcmp(view.data, large + i, view.length) == 0);
+		}
+	}
+	CHECK(bmap_get(&m, "empty", &view) == OK && view.length == 0);
+	CHECK(bmap_get(&m, "huge", &view) == OK && view.length == sizeof(large));
+	CHECK(memcmp(view.data, large, sizeof(large)) == 0);
+	CHECK(bmap_get(&m, "missing", &view) == NO_KEY_EXISTS);
+
+	// a removed key takes another value, the copy of the old one was freed with the key
+	for (i = 0; i < 20000; i += 3) CHECK(bmap_put(&m, keys[i], large + 1000 + i, 500) == OK);
+	for (i = 0; i < 20000; i += 3) CHECK(bmap_remove(&m, keys[i]) == OK);
+	for (i = 0; i < 20000; i += 3) CHECK(bmap_put(&m, keys[i], large + 2000 + i, 13) == OK);
+	for (i = 0; i < 20000; i += 3) {
+		CHECK(bmap_get(&m, keys[i], &view) == OK && view.length == 13);
+		CHECK(memcmp(view.data, large + 2000 + i, 13) == 0);
+	}
+
+	bmap_destroy(&m);
+	CHECK(bmap_get(&m, "key1", &view) == NOT_INITIALIZED);
+	if (failures == 0) printf("bmap_test: ok\n");
+	return failures;
+}
@@ -0,0 +1,19 @@
+#ifndef __A1_CHECK_H__
+#define __A1_CHECK_H__
+
+#include <stdio.h>
+
+//
+//	The checks of the tests run by "make check". A failed check prints its location and condition and is counted,
+//	every test returns the amount of failures from main.
+//
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while (0)
+#endif
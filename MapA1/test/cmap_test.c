@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cmap.h"
+#include "check.h"
+
+//
+//	Test of the cuckoo map, run by "make check". It is built with CMAP_TESTING and its own copy of cmap.c, for the
+//	test hooks.
+//
+
+static int same(const char* a, const char* b) {
+	return a != NULL && b != NULL && strcmp(a, b) == 0;
+}
+
+// the amount of bucket allocations that succeed, the ones after fail
+static int allocations;
+
+static void* cmap_allocate_limited(size_t alignment, size_t size) {
+	if (allocations == 0) return NULL;
+	allocations--;
+	return aligned_alloc(alignment, size);
+}
+
+int main() {
+	static char keys[100000][16];
+	cmap_t m;
+	CHECK(cmap_init(&m) == OK);
+	int i;
+	for (i = 0; i < 100000; i++) {
+		sprintf(keys[i], "key%d", i);
+		CHECK(cmap_put(&m, keys[i], i % 2 ? keys[i] : NULL) == OK);
+	}
+	CHECK(cmap_put(&m, "key5", "other") == KEY_EXISTS);
+	CHECK(cmap_size(&m) == 100000);
+
+	// the keys moved between their buckets are all found, the map is filled well before it grows
+	for (i = 0; i < 100000; i++) {
+		const char* value = cmap_get(&m, keys[i]);
+		CHECK(i % 2 ? same(value, keys[i]) : value == NULL);
+	}
+	CHECK((double)cmap_size(&m) / (m.capacity * CMAP_WAYS) > 0.4);
+
+	// removed keys free their slots, which new keys take
+	for (i = 0; i < 100000; i += 3) CHECK(cmap_remove(&m, keys[i]) == OK);
+	CHECK(cmap_remove(&m, "key0") == NO_KEY_EXISTS);
+	const unsigned int capacity = m.capacity;
+	for (i = 0; i < 100000; i += 6) CHECK(cmap_put(&m, keys[i], keys[i]) == OK);
+	CHECK(m.capacity == capacity);
+	for (i = 0; i < 100000; i++) {
+		const char* value = cmap_get(&m, keys[i]);
+		if (i % 6 == 0) {
+			CHECK(same(value, keys[i]));
+		} else if (i % 3 == 0) {
+			CHECK(value == NULL && cmap_remove(&m, keys[i]) == NO_KEY_EXISTS);
+		} else {
+			CHECK(i % 2 ? same(value, keys[i]) : value == NULL);
+		}
+	}
+	CHECK(cmap_get(&m, "missing") == NULL);
+
+	cmap_destroy(&m);
+
+	// keys whose hashes select the same two buckets out of 8 cannot all be placed, the map switches to SipHash
+	CHECK(cmap_init(&m) == OK);
+	static char colliding[8][16];
+	unsigned int n = 0;
+	for (i = 0; n < 8; i++) {
+		sprintf(colliding[n], "c%d", i);
+		unsigned int first, second;
+		cmap_buckets(&m, colliding[n], 8, &first, &second);
+		if (first == 0 && second == 5) n++;
+	}
+	for (i = 0; i < 6; i++) CHECK(cmap_put(&m, colliding[i], colliding[i]) == OK);
+
+	// the rebuild with FNV1 fails to place the keys, the one with SipHash fails to allocate, the map is unchanged
+	cmap_allocate = cmap_allocate_limited;
+	allocations = 1;
+	CHECK(cmap_put(&m, colliding[6], colliding[6]) == SYS_ERROR);
+	cmap_allocate = aligned_alloc;
+	CHECK(m.hashKind == MAP_HASH_FNV1 && cmap_size(&m) == 6);
+	for (i = 0; i < 6; i++) CHECK(same(cmap_get(&m, colliding[i]), colliding[i]));
+	CHECK(cmap_get(&m, colliding[6]) == NULL);
+
+	for (i = 6; i < 8; i++) CHECK(cmap_put(&m, colliding[i], colliding[i]) == OK);
+	CHECK(m.hashKind == MAP_HASH_SIPHASH);
+	for (i = 0; i < 8; i++) CHECK(same(cmap_get(&m, colliding[i]), colliding[i]));
+	cmap_destroy(&m);
+	CHECK(cmap_put(&m, "a", "1") == NOT_INITIALIZED && cmap_get(&m, "a") == NULL);
+	if (failures == 0) printf("cmap_test: ok\n");
+	return failures;
+}
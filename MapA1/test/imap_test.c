@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "imap.h"
+#include "check.h"
+
+//
+//	Test of the integer map, run by "make check".
+//
+
+// the key that is mixed into the marker of a deleted slot, like 0 it is kept outside of the slots
+#define SPECIAL_KEY 0x50BF096683646DF0ULL
+
+// returns the key that the map mixes into the provided value (the inverse of the finalizer of MurmurHash3)
+static uint64_t unmix(uint64_t mixed) {
+	mixed ^= mixed >> 33;
+	mixed *= 0x9CB4B2F8129337DBULL;
+	mixed ^= mixed >> 33;
+	mixed *= 0x4F74430C22A54005ULL;
+	return mixed ^ (mixed >> 33);
+}
+
+int main() {
+	static int values[100000];
+	imap_t m;
+	imap_init(&m);
+	uint64_t i;
+	for (i = 0; i < 100000; i++) CHECK(imap_put(&m, i, values + i) == OK);
+	CHECK(imap_put(&m, 5, NULL) == KEY_EXISTS);
+	CHECK(imap_put(&m, SPECIAL_KEY, values) == OK);
+	CHECK(imap_put(&m, SPECIAL_KEY, NULL) == KEY_EXISTS);
+	CHECK(imap_size(&m) == 100001);
+	CHECK(imap_get(&m, 0) == values && imap_get(&m, SPECIAL_KEY) == values);
+
+	// remove every other key and put some of them back into the deleted slots
+	for (i = 0; i < 100000; i += 2) CHECK(imap_remove(&m, i) == OK);
+	CHECK(imap_remove(&m, 0) == NO_KEY_EXISTS);
+	CHECK(imap_remove(&m, SPECIAL_KEY) == OK);
+	CHECK(imap_get(&m, SPECIAL_KEY) == NULL);
+	for (i = 0; i < 100000; i += 4) CHECK(imap_put(&m, i, values + i) == OK);
+	CHECK(imap_size(&m) == 75000);
+	for (i = 0; i < 100000; i++) CHECK(imap_get(&m, i) == (i % 4 == 2 ? NULL : values + i));
+	CHECK(imap_get(&m, 1ULL << 40) == NULL);
+
+	imap_destroy(&m);
+	CHECK(imap_get(&m, 1) == NULL);
+
+	// a key taking over the deleted slot at the start of a long chain counts the whole chain, which it searched for
+	// the key, so the map that is more than three quarters full grows
+	imap_init(&m);
+	for (i = 1; i <= 192; i++) CHECK(imap_put(&m, unmix(i << 32), values + i) == OK);
+	CHECK(imap_put(&m, unmix((1ULL << 32) | 200), values) == OK);
+	CHECK(m.capacity == 256 && m.allocated == 193);
+	CHECK(imap_remove(&m, unmix(1ULL << 32)) == OK);
+	CHECK(imap_put(&m, unmix(193ULL << 32), values + 193) == OK);
+	CHECK(m.capacity > 256 && m.allocated == (unsigned int)imap_size(&m));
+	for (i = 2; i <= 193; i++) CHECK(imap_get(&m, unmix(i << 32)) == values + i);
+	imap_destroy(&m);
+	if (failures == 0) printf("imap_test: ok\n");
+	return failures;
+}
@@ -0,0 +1,51 @@
+#include <cstdio>
+#include <string>
+#include "map.hpp"
+#include "check.h"
+
+//
+//	Test of the C++ map, run by "make check".
+//
+
+struct Point {
+	int x;
+	int y;
+};
+
+int main() {
+	// integer keys with a trivially copyable value, rebuilt with memcpy
+	a1::Map<uint64_t, Point> points;
+	for (uint64_t i = 0; i < 100000; i++) CHECK(points.put(i, Point{ (int)i, -(int)i }) == OK);
+	CHECK(points.put(5, Point{ 0, 0 }) == KEY_EXISTS);
+	CHECK(points.size() == 100000);
+	for (uint64_t i = 0; i < 100000; i += 2) CHECK(points.remove(i) == OK);
+	CHECK(points.remove(0) == NO_KEY_EXISTS);
+	points.optimize();
+	CHECK(points.size() == 50000);
+	for (uint64_t i = 0; i < 100000; i++) {
+		const Point* p = points.get(i);
+		CHECK(i % 2 ? p != nullptr && p->x == (int)i && p->y == -(int)i : p == nullptr);
+	}
+
+	// keys and values that are moved, removed slots are reused
+	a1::Map<std::string, std::string> strings;
+	for (int i = 0; i < 10000; i++) CHECK(strings.put("key" + std::to_string(i), std::string(i % 50, 'v')) == OK);
+	for (int i = 0; i < 10000; i += 3) CHECK(strings.remove("key" + std::to_string(i)) == OK);
+	for (int i = 0; i < 10000; i += 3) CHECK(strings.put("key" + std::to_string(i), "again") == OK);
+	for (int i = 0; i < 10000; i++) {
+		const std::string* value = strings.get("key" + std::to_string(i));
+		CHECK(value != nullptr && *value == (i % 3 ? std::string(i % 50, 'v') : "again"));
+	}
+	a1::Map<std::string, std::string> moved(std::move(strings));
+	CHECK(moved.size() == 10000 && strings.size() == 0 && strings.get("key1") == nullptr);
+	CHECK(strings.put("key1", "new") == OK && *strings.get("key1") == "new");
+
+	// C strings are compared by their content
+	a1::Map<const char*, double> numbers;
+	char key[] = "pi";
+	CHECK(numbers.put("pi", 3.14) == OK);
+	CHECK(numbers.get(key) != nullptr && *numbers.get(key) == 3.14);
+
+	if (failures == 0) std::printf("map_hpp_test: ok\n");
+	return failures;
+}
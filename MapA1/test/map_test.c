@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "map.h"
+#include "snapshot.h"
+#include "crc32c.h"
+#include "check.h"
+
+//
+//	Test of the map, run by "make check".
+//
+
+static int same(const char* a, const char* b) {
+	return a != NULL && b != NULL && strcmp(a, b) == 0;
+}
+
+// the layout of the formats (see snapshot.c): the size of the headers, the offsets of the version and of the
+// checksum of the header, the size of the block header ending a snapshot and of the trailer of an image
+#define SNAPSHOT_HEADER 48
+#define SNAPSHOT_HEADER_CHECKSUM 40
+#define SNAPSHOT_END 20
+#define IMAGE_HEADER 64
+#define IMAGE_HEADER_CHECKSUM 56
+#define IMAGE_TRAILER 8
+#define VERSION 8
+
+//
+//	Writes the bytes to a new stream, checks it with map_validate and loads it as a snapshot or an image. Returns 1
+//	if both return the expected status.
+//
+static int loads(const unsigned char* bytes, const size_t length, const int image, const int expected) {
+	FILE* stream = tmpfile();
+	if (stream == NULL) return 0;
+	int result = fwrite(bytes, 1, length, stream) == length ? 1 : 0;
+	rewind(stream);
+	if (map_validate(stream) != expected) result = 0;
+	rewind(stream);
+
+	map_t map;
+	map_init(&map);
+	if ((image ? map_deserialize_image(&map, stream) : map_deserialize(&map, stream)) != expected) result = 0;
+	map_destroy(&map);
+	fclose(stream);
+	return result;
+}
+
+// stores a number little endian, like the formats
+static void store32(unsigned char* p, const uint32_t v) {
+	p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+//
+//	Checks that a snapshot or an image is rejected after each kind of damage: a changed byte in the header, in the
+//	body and at the end, a missing end and a version this build does not know.
+//
+static void rejects(const unsigned char* bytes, const size_t length, const int image) {
+	const size_t header = image ? IMAGE_HEADER : SNAPSHOT_HEADER;
+	const size_t checksum = image ? IMAGE_HEADER_CHECKSUM : SNAPSHOT_HEADER_CHECKSUM;
+	const size_t end = image ? IMAGE_TRAILER : SNAPSHOT_END;
+	CHECK(length > header + end);
+	CHECK(loads(bytes, length, image, OK));
+
+	unsigned char* damaged = malloc(length);
+	CHECK(damaged != NULL);
+	if (damaged == NULL) return;
+	// a byte of the header and of its checksum, of the first and of a middle block or of the entries and the strings,
+	// of the end block or of the trailer
+	const size_t flipped[] = { VERSION + 4, checksum, header + 5, header + (length - header - end) / 2, length - end,
+		length - 1 };
+	unsigned int i;
+	for (i = 0; i < sizeof(flipped) / sizeof(flipped[0]); i++) {
+		memcpy(damaged, bytes, length);
+		damaged[flipped[i]] ^= 0x10;
+		CHECK(loads(damaged, length, image, INVALID_FORMAT));
+	}
+
+	memcpy(damaged, bytes, length);
+	CHECK(loads(damaged, length - 1, image, INVALID_FORMAT));
+	CHECK(loads(damaged, length - end, image, INVALID_FORMAT));
+	CHECK(loads(damaged, header / 2, image, INVALID_FORMAT));
+	CHECK(loads(damaged, 0, image, INVALID_FORMAT));
+
+	// a version with an intact header checksum is reported as such, without one the header is corrupted
+	damaged[VERSION]++;
+	CHECK(loads(damaged, length, image, INVALID_FORMAT));
+	store32(damaged + checksum, map_crc32c(0, damaged, checksum));
+	CHECK(loads(damaged, length, image, UNSUPPORTED_VERSION));
+	free(damaged);
+}
+
+int main() {
+	map_t* m = malloc(sizeof(map_t));
+	map_init(m);
+	CHECK(map_put(m, "a", "1") == OK);
+	CHECK(map_put(m, "b", "2") == OK);
+	CHECK(map_put(m, "c", "3") == OK);
+	CHECK(map_put(m, "d", "4") == OK);
+	CHECK(map_put(m, "e", "5") == OK);
+	CHECK(map_put(m, "f", "This is testing the map_put functions") == OK);
+	CHECK(map_put(m, "tester", "tested") == OK);
+	CHECK(map_put(m, "a", "other") == KEY_EXISTS);
+
+	CHECK(map_remove(m, "b") == OK);
+	CHECK(map_remove(m, "b") == NO_KEY_EXISTS);
+	CHECK(map_size(m) == 6);
+	CHECK(same(map_get(m, "a"), "1"));
+	CHECK(same(map_get(m, "tester"), "tested"));
+	CHECK(map_remove(m, "tester") == OK);
+	CHECK(map_get(m, "tester") == NULL);
+	CHECK(same(map_get(m, "f"), "This is testing the map_put functions"));
+
+	// grow the map over several rebuilds and write it to a snapshot
+	static char keys[10000][16];
+	int i;
+	for (i = 0; i < 10000; i++) {
+		sprintf(keys[i], "key%d", i);
+		CHECK(map_put(m, keys[i], i % 2 ? keys[i] : NULL) == OK);
+	}
+	CHECK(map_size(m) == 10005);
+
+	FILE* stream = tmpfile();
+	CHECK(stream != NULL);
+	if (stream != NULL) {
+		CHECK(map_serialize(m, stream) == OK);
+		rewind(stream);
+
+		map_t loaded;
+		map_init(&loaded);
+		CHECK(map_deserialize(&loaded, stream) == OK);
+		CHECK(map_size(&loaded) == map_size(m));
+		for (i = 0; i < 10000; i++) {
+			const char* value = map_get(&loaded, keys[i]);
+			CHECK(i % 2 ? same(value, keys[i]) : value == NULL);
+		}
+		CHECK(same(map_get(&loaded, "a"), "1"));
+		map_destroy(&loaded);
+
+		// the keys and values of a loaded map are owned by the map, a snapshot still writes them after the map was
+		// destroyed, also after a rebuild handed the entries over to the snapshot before
+		static char more[5000][16];
+		for (i = 0; i < 5000; i++) sprintf(more[i], "more%d", i);
+		int rebuilt;
+		for (rebuilt = 0; rebuilt < 2; rebuilt++) {
+			rewind(stream);
+			map_init(&loaded);
+			CHECK(map_deserialize(&loaded, stream) == OK);
+			FILE* copy = tmpfile();
+			CHECK(copy != NULL);
+			if (copy == NULL) {
+				map_destroy(&loaded);
+				continue;
+			}
+			map_snapshot_t snapshot;
+			CHECK(map_snapshot_begin(&snapshot, &loaded, copy, SNAPSHOT_COMPRESS) == OK);
+			CHECK(map_snapshot_step(&snapshot) == IN_PROGRESS);
+			if (rebuilt) {
+				const unsigned int capacity = loaded.capacity;
+				for (i = 0; i < 5000; i++) CHECK(map_put(&loaded, more[i], NULL) == OK);
+				CHECK(loaded.capacity > capacity);
+			}
+			map_destroy(&loaded);
+			int result;
+			do {
+				result = map_snapshot_step(&snapshot);
+			} while (result == IN_PROGRESS);
+			CHECK(result == OK);
+			map_snapshot_end(&snapshot);
+
+			rewind(copy);
+			map_init(&loaded);
+			CHECK(map_deserialize(&loaded, copy) == OK);
+			CHECK(map_size(&loaded) == map_size(m));
+			for (i = 0; i < 10000; i++) {
+				const char* value = map_get(&loaded, keys[i]);
+				CHECK(i % 2 ? same(value, keys[i]) : value == NULL);
+			}
+			CHECK(same(map_get(&loaded, "f"), "This is testing the map_put functions"));
+			map_destroy(&loaded);
+			fclose(copy);
+		}
+		fclose(stream);
+	}
+
+	// a map with a keyed hash writes a snapshot that a map with another hash loads by hashing the keys again
+	map_t seeded;
+	CHECK(map_init_hash(&seeded, 42, NULL) == ERR_NOT_IMPLEMENTED);
+	CHECK(map_init_hash(&seeded, MAP_HASH_SIPHASH, NULL) == OK);
+	for (i = 0; i < 10000; i++) CHECK(map_put(&seeded, keys[i], keys[i]) == OK);
+	stream = tmpfile();
+	CHECK(stream != NULL);
+	if (stream != NULL) {
+		CHECK(map_serialize(&seeded, stream) == OK);
+		rewind(stream);
+
+		map_t loaded;
+		CHECK(map_init_hash(&loaded, MAP_HASH_CRC32C, NULL) == OK);
+		CHECK(map_deserialize(&loaded, stream) == OK);
+		CHECK(map_size(&loaded) == 10000);
+		for (i = 0; i < 10000; i++) CHECK(same(map_get(&loaded, keys[i]), keys[i]));
+		map_destroy(&loaded);
+		fclose(stream);
+	}
+	map_destroy(&seeded);
+
+	// keys whose FNV1 hashes select the same slot make an insert probe too long, the map switches to SipHash
+	static char colliding[400][16];
+	unsigned int n = 0;
+	for (i = 0; n < 400; i++) {
+		sprintf(colliding[n], "c%d", i);
+		if ((fnv1_hash(colliding[n]) & 0xFFF) == 0) n++;
+	}
+	map_t clustered;
+	map_init(&clustered);
+	for (i = 0; i < 400; i++) CHECK(map_put(&clustered, colliding[i], colliding[i]) == OK);
+	map_stats_t stats;
+	CHECK(map_stats(&clustered, &stats) == OK);
+	CHECK(stats.reseeds > 0 && clustered.hashKind == MAP_HASH_SIPHASH);
+
+	// one cluster would make a lookup compare up to 400 slots, the map may stay more than three quarters full, where
+	// clusters of more than 100 slots happen by chance
+	CHECK(stats.maxProbe < 200);
+	for (i = 0; i < 400; i++) CHECK(same(map_get(&clustered, colliding[i]), colliding[i]));
+	map_destroy(&clustered);
+
+	// hashes of the caller, their low bits are all the same and the map still spreads the keys
+	map_t external;
+	CHECK(map_init_hash(&external, MAP_HASH_EXTERNAL, NULL) == OK);
+	for (i = 0; i < 10000; i++) CHECK(map_put_hashed(&external, keys[i], keys[i], (uint64_t)i << 16) == OK);
+	CHECK(map_put_hashed(&external, keys[0], NULL, 0) == KEY_EXISTS);
+	CHECK(map_put(&external, "a", "1") == ERR_NOT_IMPLEMENTED);
+	CHECK(map_put_hashed(m, "a", "1", 1) == ERR_NOT_IMPLEMENTED);
+	CHECK(map_stats(&external, &stats) == OK);
+	CHECK(stats.maxProbe < 100);
+	for (i = 0; i < 10000; i++) CHECK(same(map_get_hashed(&external, keys[i], (uint64_t)i << 16), keys[i]));
+	CHECK(map_remove_hashed(&external, keys[7], 7 << 16) == OK);
+	CHECK(map_get_hashed(&external, keys[7], 7 << 16) == NULL);
+	map_destroy(&external);
+
+	// equal hashes of the caller make the probes long, the map grows for them, but only up to a bound
+	CHECK(map_init_hash(&external, MAP_HASH_EXTERNAL, NULL) == OK);
+	for (i = 0; i < 300; i++) CHECK(map_put_hashed(&external, keys[i], keys[i], 42) == OK);
+	CHECK(external.capacity > 512 && external.capacity <= 300 * 16);
+	for (i = 0; i < 300; i++) CHECK(same(map_get_hashed(&external, keys[i], 42), keys[i]));
+	map_destroy(&external);
+
+	// a map with a filter finds its keys after puts, removes, rebuilds and loading a snapshot or an image
+	map_t filtered;
+	map_init(&filtered);
+	CHECK(map_filter(&filtered, 1) == OK);
+	for (i = 0; i < 10000; i += 2) CHECK(map_put(&filtered, keys[i], keys[i]) == OK);
+	for (i = 0; i < 10000; i += 6) CHECK(map_remove(&filtered, keys[i]) == OK);
+	CHECK(map_put(&filtered, keys[0], keys[0]) == OK);
+	for (i = 0; i < 10000; i++) CHECK(same(map_get(&filtered, keys[i]), keys[i]) == (i % 2 == 0 && (i % 6 || !i)));
+	stream = tmpfile();
+	CHECK(stream != NULL);
+	if (stream != NULL) {
+		CHECK(map_serialize(&filtered, stream) == OK);
+		CHECK(map_serialize_image(&filtered, stream) == OK);
+		rewind(stream);
+
+		map_t loaded;
+		map_init(&loaded);
+		CHECK(map_filter(&loaded, 1) == OK);
+		CHECK(map_deserialize(&loaded, stream) == OK);
+		CHECK(map_size(&loaded) == map_size(&filtered));
+		for (i = 0; i < 10000; i++) CHECK(same(map_get(&loaded, keys[i]), keys[i]) == (i % 2 == 0 && (i % 6 || !i)));
+		map_destroy(&loaded);
+
+		map_init(&loaded);
+		CHECK(map_filter(&loaded, 1) == OK);
+		CHECK(map_deserialize_image(&loaded, stream) == OK);
+		for (i = 0; i < 10000; i++) CHECK(same(map_get(&loaded, keys[i]), keys[i]) == (i % 2 == 0 && (i % 6 || !i)));
+		CHECK(map_filter(&loaded, 0) == OK);
+		CHECK(same(map_get(&loaded, keys[2]), keys[2]) && map_get(&loaded, keys[1]) == NULL);
+		map_destroy(&loaded);
+		fclose(stream);
+	}
+	map_destroy(&filtered);
+
+	// a snapshot writes the map as it was when it began, although keys are put and removed and the map is rebuilt
+	// between the steps
+	map_t changing;
+	map_init(&changing);
+	for (i = 0; i < 5000; i++) CHECK(map_put(&changing, keys[i], i % 2 ? keys[i] : NULL) == OK);
+	stream = tmpfile();
+	CHECK(stream != NULL);
+	if (stream != NULL) {
+		map_snapshot_t snapshot;
+		CHECK(map_snapshot_begin(&snapshot, &changing, stream, SNAPSHOT_COMPRESS) == OK);
+		CHECK(map_snapshot_step(&snapshot) == IN_PROGRESS);
+		for (i = 0; i < 5000; i += 5) CHECK(map_remove(&changing, keys[i]) == OK);
+		for (i = 5000; i < 6000; i++) CHECK(map_put(&changing, keys[i], keys[i]) == OK);
+		CHECK(map_snapshot_step(&snapshot) == IN_PROGRESS);
+		const unsigned int capacity = changing.capacity;
+		for (i = 6000; i < 10000; i++) CHECK(map_put(&changing, keys[i], keys[i]) == OK);
+		CHECK(changing.capacity > capacity);
+		CHECK(map_snapshot_step(&snapshot) == IN_PROGRESS);
+		for (i = 1; i < 10000; i += 5) CHECK(map_remove(&changing, keys[i]) == OK);
+		int result;
+		do {
+			result = map_snapshot_step(&snapshot);
+		} while (result == IN_PROGRESS);
+		CHECK(result == OK);
+		map_snapshot_end(&snapshot);
+		rewind(stream);
+
+		map_t loaded;
+		map_init(&loaded);
+		CHECK(map_deserialize(&loaded, stream) == OK);
+		CHECK(map_size(&loaded) == 5000);
+		for (i = 0; i < 10000; i++) {
+			const char* value = map_get(&loaded, keys[i]);
+			CHECK(i >= 5000 ? value == NULL : i % 2 ? same(value, keys[i]) : value == NULL);
+		}
+		for (i = 0; i < 5000; i += 2) CHECK(map_put(&loaded, keys[i], NULL) == KEY_EXISTS);
+		map_destroy(&loaded);
+		fclose(stream);
+	}
+	map_destroy(&changing);
+
+	// damaged snapshots and images are rejected by map_validate and by the loaders
+	stream = tmpfile();
+	CHECK(stream != NULL);
+	if (stream != NULL) {
+		CHECK(map_serialize(m, stream) == OK);
+		const long snapshotLength = ftell(stream);
+		CHECK(map_serialize_image(m, stream) == OK);
+		const long length = ftell(stream);
+		unsigned char* bytes = malloc(length);
+		rewind(stream);
+		CHECK(bytes != NULL && fread(bytes, length, 1, stream) == 1);
+		if (bytes != NULL) {
+			rejects(bytes, snapshotLength, 0);
+			rejects(bytes + snapshotLength, length - snapshotLength, 1);
+		}
+		free(bytes);
+		fclose(stream);
+	}
+
+	map_destroy(m);
+	free(m);
+	if (failures == 0) printf("map_test: ok\n");
+	return failures;
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "mset.h"
+#include "check.h"
+
+//
+//	Test of the set, run by "make check".
+//
+
+int main() {
+	static char keys[30000][16];
+	mset_t a, b;
+	mset_init(&a);
+	mset_init(&b);
+	int i;
+
+	// a holds the multiples of 2, b the multiples of 3 below 30000
+	for (i = 0; i < 30000; i++) {
+		sprintf(keys[i], "key%d", i);
+		if (i % 2 == 0) CHECK(mset_add(&a, keys[i]) == OK);
+		if (i % 3 == 0) CHECK(mset_add(&b, keys[i]) == OK);
+	}
+	CHECK(mset_add(&a, "key0") == KEY_EXISTS);
+	CHECK(mset_size(&a) == 15000 && mset_size(&b) == 10000);
+	CHECK(mset_contains(&a, "key2") && !mset_contains(&a, "key3"));
+
+	// remove the multiples of 10 from a and put the multiples of 20 back into the deleted slots
+	for (i = 0; i < 30000; i += 10) CHECK(mset_remove(&a, keys[i]) == OK);
+	CHECK(mset_remove(&a, "key0") == NO_KEY_EXISTS);
+	for (i = 0; i < 30000; i += 20) CHECK(mset_add(&a, keys[i]) == OK);
+	CHECK(mset_size(&a) == 13500);
+
+	// a & b holds the multiples of 6 except the odd multiples of 10 (30, 90, ...)
+	mset_t c;
+	mset_init(&c);
+	CHECK(mset_union(&c, &a) == OK);
+	CHECK(mset_intersect(&c, &b) == OK);
+	for (i = 0; i < 30000; i++) CHECK(mset_contains(&c, keys[i]) == (i % 6 == 0 && (i % 10 != 0 || i % 20 == 0)));
+
+	// a | b
+	CHECK(mset_union(&a, &b) == OK);
+	CHECK(mset_union(&a, &a) == OK && mset_intersect(&a, &a) == OK);
+	for (i = 0; i < 30000; i++) {
+		CHECK(mset_contains(&a, keys[i]) == ((i % 2 == 0 && (i % 10 != 0 || i % 20 == 0)) || i % 3 == 0));
+	}
+
+	mset_destroy(&a);
+	mset_destroy(&b);
+	mset_destroy(&c);
+	CHECK(mset_add(&a, "key1") == NOT_INITIALIZED && !mset_contains(&a, "key2"));
+	if (failures == 0) printf("mset_test: ok\n");
+	return failures;
+}
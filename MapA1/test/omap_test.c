@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "omap.h"
+#include "check.h"
+
+//
+//	Test of the ordered map, run by "make check".
+//
+
+static int same(const char* a, const char* b) {
+	return a != NULL && b != NULL && strcmp(a, b) == 0;
+}
+
+// returns the amount of index slots that point to an entry, valid or removed
+static unsigned int taken(const omap_t* m) {
+	unsigned int n = 0;
+	unsigned int i;
+	for (i = 0; i < m->capacity; i++) {
+		switch (m->width) {
+			case 1: n += ((const uint8_t*)m->index)[i] != 0; break;
+			case 2: n += ((const uint16_t*)m->index)[i] != 0; break;
+			default: n += ((const uint32_t*)m->index)[i] != 0; break;
+		}
+	}
+	return n;
+}
+
+// returns 1 if the iteration returns exactly the keys whose numbers are listed, in this order
+static int iterates(omap_t* m, char keys[][16], const int* order, const int count) {
+	unsigned int cursor = 0;
+	const char* key;
+	const char* value;
+	int n = 0;
+	while (omap_next(m, &cursor, &key, &value)) {
+		if (n >= count || key != keys[order[n]] || value != keys[order[n]]) return 0;
+		n++;
+	}
+	return n == count;
+}
+
+int main() {
+	static char keys[100000][16];
+	static int order[100000];
+	omap_t m;
+	omap_init(&m);
+	int i;
+	for (i = 0; i < 100000; i++) sprintf(keys[i], "key%d", i);
+
+	// the iteration keeps the order of the puts after removes, and after the map was compacted and grown
+	for (i = 0; i < 1000; i++) CHECK(omap_put(&m, keys[i], keys[i]) == OK);
+	CHECK(omap_put(&m, "key5", NULL) == KEY_EXISTS);
+	for (i = 0; i < 1000; i += 3) CHECK(omap_remove(&m, keys[i]) == OK);
+	CHECK(omap_remove(&m, "key0") == NO_KEY_EXISTS);
+	CHECK(omap_get(&m, "key0") == NULL && same(omap_get(&m, "key1"), "key1"));
+	int count = 0;
+	for (i = 0; i < 1000; i++) if (i % 3) order[count++] = i;
+	CHECK(iterates(&m, keys, order, count));
+	for (i = 0; i < 1000; i += 6) {
+		CHECK(omap_put(&m, keys[i], keys[i]) == OK);
+		order[count++] = i;
+	}
+	for (i = 1000; i < 3000; i++) {
+		CHECK(omap_put(&m, keys[i], keys[i]) == OK);
+		order[count++] = i;
+	}
+	CHECK(omap_size(&m) == count);
+	CHECK(iterates(&m, keys, order, count));
+	omap_destroy(&m);
+
+	// a key put after a remove takes over the index slot of the removed entry, the index does not fill up
+	omap_init(&m);
+	for (i = 0; i < 100; i++) CHECK(omap_put(&m, keys[i], keys[i]) == OK);
+	const unsigned int capacity = m.capacity;
+	const unsigned int slots = taken(&m);
+	CHECK(slots == 100);
+	for (i = 0; i < 100; i++) {
+		CHECK(omap_remove(&m, keys[i]) == OK);
+		CHECK(omap_put(&m, keys[i], keys[i]) == OK);
+		CHECK(taken(&m) == slots);
+	}
+	for (i = 0; i < 10000; i++) {
+		CHECK(omap_remove(&m, keys[i % 100]) == OK);
+		CHECK(omap_put(&m, keys[i % 100], keys[i % 100]) == OK);
+	}
+	CHECK(m.capacity == capacity && omap_size(&m) == 100);
+	// every key was moved to the end as often as the others
+	for (i = 0; i < 100; i++) order[i] = i;
+	CHECK(iterates(&m, keys, order, 100));
+	omap_destroy(&m);
+
+	// the index slots are 1 byte up to 255 entries, 2 bytes up to 65535 entries and 4 bytes beyond, every key is
+	// found after each change of the width
+	omap_init(&m);
+	unsigned int width = m.width;
+	CHECK(width == 1);
+	for (i = 0; i < 100000; i++) {
+		CHECK(omap_put(&m, keys[i], keys[i]) == OK);
+		CHECK(m.width == (m.limit < 0xFF ? 1u : m.limit < 0xFFFF ? 2u : 4u));
+		if (m.width != width) {
+			CHECK(m.width == width * 2);
+			width = m.width;
+			int j;
+			for (j = 0; j <= i; j++) CHECK(same(omap_get(&m, keys[j]), keys[j]));
+		}
+	}
+	CHECK(width == 4);
+	for (i = 0; i < 100000; i++) order[i] = i;
+	CHECK(iterates(&m, keys, order, 100000));
+	omap_destroy(&m);
+	CHECK(omap_put(&m, "a", "1") == NOT_INITIALIZED && omap_get(&m, "a") == NULL);
+
+	if (failures == 0) printf("omap_test: ok\n");
+	return failures;
+}
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "map.h"
+#include "counters.h"
+#include "check.h"
+
+//
+//	Test of the trace hook and the counters, run by "make check". It is built with MAP_TRACE and MAP_COUNTERS
+//	against a library built with both.
+//
+
+#define THREADS 4
+#define KEYS 10000
+
+static char keys[KEYS][16];
+
+// the events received by the hook
+static int events[8];
+static const map_t* traced;
+static int applied = 1;
+
+static void tracer(const map_t* map, const int event, const char* key) {
+	if (map != traced || event < 0 || event >= 8) return;
+	events[event]++;
+
+	// a put is reported after the key was added and a remove after the key was removed
+	map_t* self = (map_t*)map;
+	if (event == MAP_EVENT_PUT && (key == NULL || map_get(self, key) == NULL)) applied = 0;
+	if (event == MAP_EVENT_REMOVE && (key == NULL || map_get(self, key) != NULL)) applied = 0;
+	if ((event == MAP_EVENT_REBUILD || event == MAP_EVENT_DESTROY) && key != NULL) applied = 0;
+}
+
+// the threads fill their own maps and wait until the main thread read their counters
+static pthread_barrier_t counted;
+static pthread_barrier_t released;
+
+static void* worker(void* argument) {
+	(void)argument;
+	map_t map;
+	map_init(&map);
+	int i;
+	for (i = 0; i < KEYS; i++) map_put(&map, keys[i], keys[i]);
+	for (i = 0; i < KEYS; i++) map_get(&map, keys[i]);
+	map_get(&map, "missing");
+	map_destroy(&map);
+	pthread_barrier_wait(&counted);
+	pthread_barrier_wait(&released);
+	return NULL;
+}
+
+int main() {
+	int i;
+	for (i = 0; i < KEYS; i++) sprintf(keys[i], "key%d", i);
+
+	// the hook receives the changes of the map, failed changes are not reported
+	map_t map;
+	map_init(&map);
+	traced = &map;
+	map_trace_set(tracer);
+	for (i = 0; i < KEYS; i++) CHECK(map_put(&map, keys[i], keys[i]) == OK);
+	CHECK(map_put(&map, keys[0], NULL) == KEY_EXISTS);
+	for (i = 0; i < KEYS; i += 2) CHECK(map_remove(&map, keys[i]) == OK);
+	CHECK(map_remove(&map, keys[0]) == NO_KEY_EXISTS);
+	CHECK(events[MAP_EVENT_PUT] == KEYS && events[MAP_EVENT_REMOVE] == KEYS / 2);
+	CHECK(events[MAP_EVENT_REBUILD] > 0 && events[MAP_EVENT_DESTROY] == 0);
+	CHECK(applied);
+	map_destroy(&map);
+	CHECK(events[MAP_EVENT_DESTROY] == 1);
+	map_trace_set(NULL);
+	map_init(&map);
+	CHECK(map_put(&map, keys[0], NULL) == OK);
+	CHECK(events[MAP_EVENT_PUT] == KEYS);
+	map_destroy(&map);
+
+	// the counters of the main thread, a removed key put again takes its old slot
+	map_counters_t counters;
+	map_counters_reset();
+	map_counters_read(&counters);
+	for (i = 0; i < MAP_COUNTER_COUNT; i++) CHECK(counters.counts[i] == 0);
+	map_init(&map);
+	for (i = 0; i < KEYS; i++) CHECK(map_put(&map, keys[i], keys[i]) == OK);
+	for (i = 0; i < KEYS; i++) CHECK(map_get(&map, keys[i]) != NULL);
+	CHECK(map_get(&map, "missing") == NULL);
+	CHECK(map_remove(&map, keys[7]) == OK);
+	CHECK(map_remove(&map, keys[7]) == NO_KEY_EXISTS);
+	CHECK(map_put(&map, keys[7], keys[7]) == OK);
+	map_counters_read(&counters);
+	CHECK(counters.counts[MAP_COUNTER_INSERT] == KEYS + 1);
+	CHECK(counters.counts[MAP_COUNTER_HIT] == KEYS && counters.counts[MAP_COUNTER_MISS] == 1);
+	CHECK(counters.counts[MAP_COUNTER_REMOVE] == 1 && counters.counts[MAP_COUNTER_REUSE] == 1);
+	CHECK(counters.counts[MAP_COUNTER_RESIZE] > 0 && counters.counts[MAP_COUNTER_RESIZE_NANOS] > 0);
+	CHECK(counters.counts[MAP_COUNTER_OVERWRITE] == 0 && counters.counts[MAP_COUNTER_RESEED] == 0);
+	map_destroy(&map);
+
+	// the counts of other threads are added up while they run and after they ended
+	map_counters_reset();
+	pthread_barrier_init(&counted, NULL, THREADS + 1);
+	pthread_barrier_init(&released, NULL, THREADS + 1);
+	pthread_t threads[THREADS];
+	for (i = 0; i < THREADS; i++) CHECK(pthread_create(threads + i, NULL, worker, NULL) == 0);
+	pthread_barrier_wait(&counted);
+	map_counters_read(&counters);
+	CHECK(counters.counts[MAP_COUNTER_INSERT] == THREADS * KEYS);
+	CHECK(counters.counts[MAP_COUNTER_HIT] == THREADS * KEYS && counters.counts[MAP_COUNTER_MISS] == THREADS);
+	pthread_barrier_wait(&released);
+	for (i = 0; i < THREADS; i++) pthread_join(threads[i], NULL);
+	map_counters_t ended;
+	map_counters_read(&ended);
+	CHECK(memcmp(&ended, &counters, sizeof(counters)) == 0);
+	pthread_barrier_destroy(&counted);
+	pthread_barrier_destroy(&released);
+
+	// a reset while the ended threads are summed up starts from zero again
+	map_counters_reset();
+	map_counters_read(&counters);
+	CHECK(counters.counts[MAP_COUNTER_INSERT] == 0 && counters.counts[MAP_COUNTER_HIT] == 0);
+
+	if (failures == 0) printf("trace_test: ok\n");
+	return failures;
+}
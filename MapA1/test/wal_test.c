@@ -0,0 +1,222 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "map.h"
+#include "snapshot.h"
+#include "wal.h"
+#include "check.h"
+
+//
+//	Test of the write-ahead log and the recovery, run by "make check". The files are written to a new directory in
+//	/tmp, which is removed at the end.
+//
+
+static char keys[2000][16];
+static char values[2000][16];
+
+//
+//	Checks that both maps hold the same keys with the same values.
+//
+static int equal(map_t* a, map_t* b) {
+	if (map_size(a) != map_size(b)) return 0;
+	unsigned int i;
+	for (i = 0; i < a->capacity; i++) {
+		const map_entry_t* entry = a->entries + i;
+		if (entry->key == NULL) continue;
+		const char* value = map_get(b, entry->key);
+		if (entry->value == NULL ? value != NULL || map_put(b, entry->key, NULL) != KEY_EXISTS
+				: value == NULL || strcmp(value, entry->value) != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+//
+//	Recovers a new map from the snapshot and the log and compares it with the expected one.
+//
+static int recovered(const char* snapshot, const char* log, map_t* expected) {
+	map_t map;
+	map_init(&map);
+	int result = map_recover(&map, snapshot, log) == OK && equal(expected, &map);
+	map_destroy(&map);
+	return result;
+}
+
+//
+//	Appends bytes to the end of a file.
+//
+static void append(const char* path, const void* bytes, const size_t length) {
+	FILE* file = fopen(path, "ab");
+	CHECK(file != NULL && fwrite(bytes, length, 1, file) == 1);
+	if (file != NULL) fclose(file);
+}
+
+//
+//	Writes a snapshot of the map to a file, cut after the provided amount of bytes.
+//
+static void dump(map_t* map, const char* path, const long length) {
+	FILE* file = fopen(path, "w+b");
+	CHECK(file != NULL && map_serialize(map, file) == OK);
+	if (file != NULL) {
+		fflush(file);
+		if (length >= 0) CHECK(ftruncate(fileno(file), length) == 0);
+		fclose(file);
+	}
+}
+
+static long size(const char* path) {
+	struct stat info;
+	return stat(path, &info) == 0 ? (long)info.st_size : -1;
+}
+
+int main() {
+	char directory[] = "/tmp/wal_test.XXXXXX";
+	CHECK(mkdtemp(directory) != NULL);
+	char log[64];
+	sprintf(log, "%s/log", directory);
+	int i;
+	for (i = 0; i < 2000; i++) {
+		sprintf(keys[i], "key%d", i);
+		sprintf(values[i], "value%d", i);
+	}
+
+	// puts with and without values and removes are logged in groups of 7, the tail by map_wal_close
+	map_t map;
+	map_init(&map);
+	map_wal_t wal;
+	CHECK(map_wal_open(&wal, log, WAL_SYNC_NONE, 7, 0) == OK);
+	CHECK(map_wal_attach(&map, &wal) == OK);
+	for (i = 0; i < 1000; i++) CHECK(map_put(&map, keys[i], i % 5 ? values[i] : NULL) == OK);
+	for (i = 0; i < 1000; i += 3) CHECK(map_remove(&map, keys[i]) == OK);
+	CHECK(map_put(&map, keys[3], values[4]) == OK);
+	CHECK(map_put(&map, keys[1], values[1]) == KEY_EXISTS);
+	CHECK(map_remove(&map, keys[0]) == NO_KEY_EXISTS);
+	CHECK(map_wal_close(&wal) == OK);
+	CHECK(map_wal_attach(&map, NULL) == OK);
+	CHECK(recovered(NULL, log, &map));
+
+	// a torn record at the end is cut off by the recovery, the records appended afterwards are replayed as well
+	const long complete = size(log);
+	append(log, "\x12\x34\x56\x78\x01\x05\x00", 7);
+	CHECK(recovered(NULL, log, &map));
+	CHECK(size(log) == complete);
+	CHECK(map_wal_open(&wal, log, WAL_SYNC_COMMIT, 1, 0) == OK);
+	CHECK(map_wal_attach(&map, &wal) == OK);
+	CHECK(map_put(&map, keys[1000], values[1000]) == OK);
+	CHECK(map_wal_close(&wal) == OK);
+	CHECK(map_wal_attach(&map, NULL) == OK);
+	CHECK(recovered(NULL, log, &map));
+
+	// a record with a wrong checksum ends the replay, the map is recovered up to the record before it
+	CHECK(map_wal_open(&wal, log, WAL_SYNC_NONE, 100, 0) == OK);
+	CHECK(map_wal_attach(&map, &wal) == OK);
+	CHECK(map_put(&map, keys[1001], values[1001]) == OK);
+	CHECK(map_wal_close(&wal) == OK);
+	CHECK(map_wal_attach(&map, NULL) == OK);
+	FILE* file = fopen(log, "r+b");
+	CHECK(file != NULL);
+	if (file != NULL) {
+		fseek(file, -1, SEEK_END);
+		const int last = fgetc(file);
+		fseek(file, -1, SEEK_END);
+		fputc(last ^ 1, file);
+		fclose(file);
+	}
+	CHECK(map_remove(&map, keys[1001]) == OK);
+	CHECK(recovered(NULL, log, &map));
+
+	// a group that cannot be written stays buffered and the log refuses all changes until it is reopened
+	CHECK(map_wal_open(&wal, log, WAL_SYNC_NONE, 100, 0) == OK);
+	CHECK(map_wal_attach(&map, &wal) == OK);
+	for (i = 1100; i < 1150; i++) CHECK(map_put(&map, keys[i], values[i]) == OK);
+	close(wal.fd);
+	CHECK(map_wal_commit(&wal) == SYS_ERROR);
+	CHECK(map_put(&map, keys[1150], values[1150]) == SYS_ERROR && map_get(&map, keys[1150]) == NULL);
+	CHECK(map_remove(&map, keys[1100]) == SYS_ERROR && map_get(&map, keys[1100]) != NULL);
+	CHECK(map_wal_reopen(&wal) == OK);
+	CHECK(map_remove(&map, keys[1101]) == OK);
+	CHECK(map_wal_close(&wal) == OK);
+	CHECK(map_wal_attach(&map, NULL) == OK);
+	CHECK(recovered(NULL, log, &map));
+
+	// an append committing a group that fails is not applied
+	CHECK(map_wal_open(&wal, log, WAL_SYNC_NONE, 2, 0) == OK);
+	CHECK(map_wal_attach(&map, &wal) == OK);
+	CHECK(map_put(&map, keys[1200], values[1200]) == OK);
+	close(wal.fd);
+	CHECK(map_put(&map, keys[1201], values[1201]) == SYS_ERROR && map_get(&map, keys[1201]) == NULL);
+	CHECK(map_wal_reopen(&wal) == OK);
+	CHECK(map_wal_close(&wal) == OK);
+	CHECK(map_wal_attach(&map, NULL) == OK);
+	CHECK(recovered(NULL, log, &map));
+
+	// a compaction stopped after each of its steps, the map is recovered from the snapshot and both logs
+	char snapshot[64], frozen[64], temporary[64];
+	sprintf(snapshot, "%s/snapshot", directory);
+	sprintf(frozen, "%s/log" WAL_FROZEN_SUFFIX, directory);
+	sprintf(temporary, "%s/snapshot" WAL_TEMPORARY_SUFFIX, directory);
+	CHECK(map_wal_open(&wal, log, WAL_SYNC_NONE, 10, 0) == OK);
+	CHECK(map_wal_attach(&map, &wal) == OK);
+	CHECK(map_wal_rotate(&wal) == OK);
+	CHECK(size(frozen) > 16 && size(log) == 16 && size(snapshot) < 0);
+	for (i = 1300; i < 1400; i++) CHECK(map_put(&map, keys[i], values[i]) == OK);
+	for (i = 1; i < 1400; i += 4) map_remove(&map, keys[i]);
+	CHECK(map_wal_commit(&wal) == OK);
+	CHECK(recovered(snapshot, log, &map));
+	CHECK(map_wal_rotate(&wal) == IN_PROGRESS);
+
+	// the merged snapshot was written partly to the temporary file, then completely and renamed
+	map_t merged;
+	map_init(&merged);
+	CHECK(map_recover(&merged, NULL, frozen) == OK);
+	dump(&merged, temporary, 100);
+	CHECK(recovered(snapshot, log, &map));
+	unlink(temporary);
+	dump(&merged, snapshot, -1);
+	CHECK(size(frozen) > 16);
+	CHECK(recovered(snapshot, log, &map));
+	map_destroy(&merged);
+
+	// a compaction started while the old log still exists merges it without rotating the log again
+	map_compact_t compaction;
+	CHECK(map_compact_start(&compaction, &wal, snapshot) == OK);
+	CHECK(map_compact_wait(&compaction) == OK);
+	CHECK(size(frozen) < 0 && size(temporary) < 0 && size(log) > 16);
+	CHECK(recovered(snapshot, log, &map));
+
+	// the map is changed while a compaction runs, the changes are in the new log
+	for (i = 1400; i < 1500; i++) CHECK(map_put(&map, keys[i], values[i]) == OK);
+	CHECK(map_wal_commit(&wal) == OK);
+	CHECK(map_compact_start(&compaction, &wal, snapshot) == OK);
+	for (i = 1500; i < 1600; i++) CHECK(map_put(&map, keys[i], values[i]) == OK);
+	for (i = 1400; i < 1600; i += 3) CHECK(map_remove(&map, keys[i]) == OK);
+	CHECK(map_compact_wait(&compaction) == OK);
+	CHECK(map_wal_commit(&wal) == OK);
+	CHECK(size(frozen) < 0 && size(temporary) < 0);
+	CHECK(recovered(snapshot, log, &map));
+
+	// a compaction started while another one runs does not start a thread, the next one starts after the wait
+	map_compact_t second;
+	memset(&second, 0, sizeof(second));
+	CHECK(map_compact_start(&compaction, &wal, snapshot) == OK);
+	CHECK(map_compact_start(&second, &wal, snapshot) == IN_PROGRESS);
+	CHECK(second.snapshotPath == NULL && second.wal == NULL);
+	CHECK(map_compact_wait(&compaction) == OK);
+	CHECK(map_compact_start(&second, &wal, snapshot) == OK);
+	CHECK(map_compact_wait(&second) == OK);
+	CHECK(size(frozen) < 0 && size(temporary) < 0);
+	CHECK(recovered(snapshot, log, &map));
+	CHECK(map_wal_close(&wal) == OK);
+	CHECK(map_wal_attach(&map, NULL) == OK);
+
+	map_destroy(&map);
+	unlink(snapshot);
+	unlink(log);
+	rmdir(directory);
+	if (failures == 0) printf("wal_test: ok\n");
+	return failures;
+}
@@ -0,0 +1,630 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "crc32c.h"
+#include "map.h"
+#include "map_internal.h"
+#include "snapshot.h"
+#include "wal.h"
+
+// the size of the file header and of a record without the key and value
+#define WAL_HEADER 16
+#define WAL_RECORD 13
+
+// the length of a value that is NULL
+#define WAL_NULL 0xFFFFFFFF
+
+// the initial size of the buffer, a group is committed as well when the buffer holds more than this
+#define WAL_BUFFER_SIZE (64 << 10)
+
+// a key or value may never be larger than this, otherwise the record is considered to be corrupted
+#define WAL_MAX_LENGTH (1 << 30)
+
+
+//
+//	The log file starts with a header, followed by the records. All numbers are stored little endian.
+//
+//	header:	uint64 magic, uint32 version, uint32 reserved
+//	record:	uint32 checksum, uint8 operation, uint32 key length, uint32 value length (WAL_NULL if the value is NULL),
+//			key, value
+//
+//	The checksum is a CRC32C (see crc32c.h) and covers everything after it up to the end of the value. When the
+//	process crashes while a group is written, the last record may be incomplete, recovery then stops at the first
+//	record that is incomplete or has a wrong checksum and cuts the file there.
+//
+
+
+//
+//	Returns the monotonic time in nanoseconds.
+//
+static uint64_t wal_now() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+//
+//	Writes all provided bytes to the file, continuing after partial writes and interrupts.
+//
+//	@param fd
+//		the file descriptor to write to.
+//	@param bytes
+//		the bytes to write.
+//	@param length
+//		the amount of bytes to write.
+//	@return
+//		OK or SYS_ERROR.
+//
+static int wal_write(const int fd, const unsigned char* bytes, size_t length) {
+	while (length > 0) {
+		const ssize_t written = write(fd, bytes, length);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return SYS_ERROR;
+		}
+		bytes += written;
+		length -= written;
+	}
+	return OK;
+}
+
+//
+//	Returns a new string with the suffix appended to the path, the caller must free it.
+//
+//	@param path
+//		the path.
+//	@param suffix
+//		the suffix to append.
+//	@return
+//		the new path or NULL if no memory is available.
+//
+static char* wal_path(const char* path, const char* suffix) {
+	const size_t length = strlen(path);
+	char* result = malloc(length + strlen(suffix) + 1);
+	if (result == NULL) return NULL;
+	memcpy(result, path, length);
+	strcpy(result + length, suffix);
+	return result;
+}
+
+//
+//	Syncs the directory containing the provided path, so that a renamed, created or deleted file is durable.
+//
+//	@param path
+//		the path of a file in the directory.
+//	@return
+//		OK or SYS_ERROR.
+//
+static int wal_sync_directory(const char* path) {
+	const char* slash = strrchr(path, '/');
+	char* directory = slash == NULL ? wal_path(".", "") : wal_path(path, "");
+	if (directory == NULL) return SYS_ERROR;
+	if (slash != NULL) directory[slash - path + 1] = 0;
+
+	const int fd = open(directory, O_RDONLY);
+	free(directory);
+	if (fd < 0) return SYS_ERROR;
+	const int result = fsync(fd) == 0 ? OK : SYS_ERROR;
+	close(fd);
+	return result;
+}
+
+//
+//	Opens the log file at the path of the log for appending and writes the header if the file is new. The size of
+//	the file is the committed size of the log afterwards.
+//
+//	@param self
+//		the log with the path and sync policy set.
+//	@return
+//		OK or SYS_ERROR.
+//
+static int wal_open_file(map_wal_t* self) {
+	self->fd = open(self->path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (self->fd < 0) return SYS_ERROR;
+
+	struct stat info;
+	if (fstat(self->fd, &info) != 0) return SYS_ERROR;
+
+	// a new log starts with the header
+	if (info.st_size == 0) {
+		unsigned char header[WAL_HEADER];
+		map_store64(header, WAL_MAGIC);
+		map_store32(header + 8, WAL_VERSION);
+		map_store32(header + 12, 0);
+		if (wal_write(self->fd, header, WAL_HEADER) != OK) return SYS_ERROR;
+		if (self->sync == WAL_SYNC_COMMIT && (fdatasync(self->fd) != 0 || wal_sync_directory(self->path) != OK)) {
+			return SYS_ERROR;
+		}
+		info.st_size = WAL_HEADER;
+	}
+	self->committed = (uint64_t)info.st_size;
+	return OK;
+}
+
+//
+//	Opens the log file for appending, creates it if it does not exist. An existing log must have been recovered
+//	using map_recover before, so that it does not end with an incomplete record.
+//
+//	@param self
+//		the log to initialize.
+//	@param path
+//		the path of the log file.
+//	@param sync
+//		the sync policy, WAL_SYNC_NONE or WAL_SYNC_COMMIT.
+//	@param batch
+//		the maximal amount of operations committed as one group.
+//	@param delay
+//		the maximal time in milliseconds an operation waits for its group to be committed, 0 for no limit.
+//	@return
+//		OK, NULL_POINTER or SYS_ERROR.
+//
+int map_wal_open(map_wal_t* self, const char* path, const int sync, const unsigned int batch, const unsigned int delay) {
+	if (self == NULL || path == NULL) return NULL_POINTER;
+
+	self->fd = -1;
+	self->sync = sync;
+	self->batch = batch > 0 ? batch : 1;
+	self->delay = (uint64_t)delay * 1000000;
+	self->used = 0;
+	self->pending = 0;
+	self->since = 0;
+	self->committed = 0;
+	self->failed = 0;
+	self->compaction = NULL;
+	self->length = WAL_BUFFER_SIZE;
+	self->buffer = malloc(self->length);
+	self->path = wal_path(path, "");
+
+	if (self->buffer == NULL || self->path == NULL || wal_open_file(self) != OK) {
+		map_wal_close(self);
+		return SYS_ERROR;
+	}
+	return OK;
+}
+
+//
+//	Appends an operation to the log. The operation is committed together with the other operations of its group.
+//
+//	@param self
+//		the log to append to.
+//	@param op
+//		WAL_PUT or WAL_REMOVE.
+//	@param key
+//		the key of the operation.
+//	@param value
+//		the value of the operation, may be NULL.
+//	@return
+//		OK or SYS_ERROR if the buffer could not grow, the group could not be committed or the log failed before.
+//
+int map_wal_append(map_wal_t* self, const int op, const char* key, const char* value) {
+	if (self->failed) return SYS_ERROR;
+	const size_t keyLength = strlen(key);
+	const size_t valueLength = value != NULL ? strlen(value) : 0;
+	const size_t bytes = WAL_RECORD + keyLength + valueLength;
+
+	// grow the buffer if a record does not fit
+	if (self->length - self->used < bytes) {
+		size_t newLength = self->length;
+		while (newLength - self->used < bytes) newLength <<= 1;
+		unsigned char* newBuffer = realloc(self->buffer, newLength);
+		if (newBuffer == NULL) return SYS_ERROR;
+		self->buffer = newBuffer;
+		self->length = newLength;
+	}
+
+	unsigned char* p = self->buffer + self->used;
+	p[4] = (unsigned char)op;
+	map_store32(p + 5, keyLength);
+	map_store32(p + 9, value != NULL ? valueLength : WAL_NULL);
+	memcpy(p + WAL_RECORD, key, keyLength);
+	if (valueLength > 0) memcpy(p + WAL_RECORD + keyLength, value, valueLength);
+	map_store32(p, map_crc32c(0, p + 4, bytes - 4));
+	self->used += bytes;
+
+	// the time is only needed if a delay is configured
+	if (self->pending++ == 0 && self->delay > 0) self->since = wal_now();
+	if (self->pending < self->batch && self->used < WAL_BUFFER_SIZE
+			&& (self->delay == 0 || wal_now() - self->since < self->delay)) {
+		return OK;
+	}
+
+	// the caller does not apply an operation that returns an error, so it leaves the group that failed
+	if (map_wal_commit(self) != OK) {
+		self->used -= bytes;
+		self->pending--;
+		return SYS_ERROR;
+	}
+	return OK;
+}
+
+//
+//	Commits the pending group of operations: writes them to the log file and syncs it, if the sync policy says so.
+//	If that fails, the part of the group that was written is cut off, the group stays in the buffer and the log
+//	fails (see map_wal_reopen).
+//
+//	@param self
+//		the log to commit.
+//	@return
+//		OK, NULL_POINTER or SYS_ERROR, also if the log failed before.
+//
+int map_wal_commit(map_wal_t* self) {
+	if (self == NULL) return NULL_POINTER;
+	if (self->failed) return SYS_ERROR;
+	if (self->pending == 0) return OK;
+
+	if (wal_write(self->fd, self->buffer, self->used) != OK
+			|| (self->sync == WAL_SYNC_COMMIT && fdatasync(self->fd) != 0)) {
+		// a torn record would end the replay, so the records of later groups would be lost
+		if (ftruncate(self->fd, (off_t)self->committed) != 0) {
+			close(self->fd);
+			self->fd = -1;
+		}
+		self->failed = 1;
+		return SYS_ERROR;
+	}
+	self->committed += self->used;
+	self->used = 0;
+	self->pending = 0;
+	return OK;
+}
+
+//
+//	Continues a log that failed: opens the log file again, cuts it back to the last committed group and commits
+//	the group that failed. If this succeeds, the log holds all operations applied to the map again.
+//
+//	@param self
+//		the log that failed.
+//	@return
+//		OK, NULL_POINTER or SYS_ERROR if the log still cannot be written, then it stays failed.
+//
+int map_wal_reopen(map_wal_t* self) {
+	if (self == NULL) return NULL_POINTER;
+	if (self->buffer == NULL || self->path == NULL) return SYS_ERROR;
+	if (!self->failed) return OK;
+
+	if (self->fd >= 0) close(self->fd);
+	const uint64_t committed = self->committed;
+	if (wal_open_file(self) != OK || self->committed < committed) return SYS_ERROR;
+	if (self->committed > committed && ftruncate(self->fd, (off_t)committed) != 0) return SYS_ERROR;
+	self->committed = committed;
+	self->failed = 0;
+	return map_wal_commit(self);
+}
+
+//
+//	Drops the last appended operation if its group was not committed yet, otherwise the log fails. Used by map_put
+//	if the operation could not be applied to the map after it was appended.
+//
+//	@param self
+//		the log.
+//	@param committed
+//		the committed size of the log before the operation was appended.
+//	@param used
+//		the amount of bytes in the buffer before the operation was appended.
+//
+void map_wal_cancel(map_wal_t* self, const uint64_t committed, const size_t used) {
+	if (!self->failed && self->committed == committed && self->used > used) {
+		self->used = used;
+		self->pending--;
+	} else {
+		self->failed = 1;
+	}
+}
+
+//
+//	Commits the pending operations and closes the log.
+//
+//	@param self
+//		the log to close.
+//	@return
+//		OK, NULL_POINTER or SYS_ERROR if the last group could not be committed, then it is lost.
+//
+int map_wal_close(map_wal_t* self) {
+	if (self == NULL) return NULL_POINTER;
+
+	int result = OK;
+	if (self->fd >= 0) {
+		if (self->buffer != NULL) result = map_wal_commit(self);
+		if (close(self->fd) != 0) result = SYS_ERROR;
+	}
+	free(self->buffer);
+	free(self->path);
+	self->buffer = NULL;
+	self->path = NULL;
+	self->fd = -1;
+	return result;
+}
+
+//
+//	Attaches the log to the map, from now on every successful put and remove is appended to it.
+//
+//	@param map
+//		the map to attach the log to.
+//	@param self
+//		the log to attach or NULL to detach the current log.
+//	@return
+//		OK, NULL_POINTER, NOT_INITIALIZED or ERR_NOT_IMPLEMENTED if the map has external hashes, those are not logged.
+//
+int map_wal_attach(map_t* map, map_wal_t* self) {
+	if (map == NULL) return NULL_POINTER;
+	if (map->magic != MAGIC) return NOT_INITIALIZED;
+	if (self != NULL && map->hashKind == MAP_HASH_EXTERNAL) return ERR_NOT_IMPLEMENTED;
+	map->wal = self;
+	return OK;
+}
+
+//
+//	Commits the pending operations, renames the log file to "<log>.old" and continues with a new log file. This is
+//	done by map_compact_start, the map must not be changed while the log is rotated.
+//
+//	@param self
+//		the log to rotate.
+//	@return
+//		OK, NULL_POINTER, IN_PROGRESS if the old log of the previous rotation still exists or SYS_ERROR.
+//
+int map_wal_rotate(map_wal_t* self) {
+	if (self == NULL) return NULL_POINTER;
+	if (map_wal_commit(self) != OK) return SYS_ERROR;
+
+	char* frozen = wal_path(self->path, WAL_FROZEN_SUFFIX);
+	if (frozen == NULL) return SYS_ERROR;
+
+	// the old log must have been merged into a snapshot, before there can be a new one
+	struct stat info;
+	if (stat(frozen, &info) == 0) {
+		free(frozen);
+		return IN_PROGRESS;
+	}
+
+	// the old log must be complete on disk, before it is renamed
+	int result = OK;
+	if (fdatasync(self->fd) != 0) result = SYS_ERROR;
+	close(self->fd);
+	self->fd = -1;
+	if (result == OK && rename(self->path, frozen) != 0) result = SYS_ERROR;
+	if (result == OK) result = wal_open_file(self);
+	free(frozen);
+	return result;
+}
+
+//
+//	Replays the records of the log file to the map. The file is cut after the last complete record, so that new
+//	records can be appended.
+//
+//	@param self
+//		the map to replay the log to.
+//	@param path
+//		the path of the log file.
+//	@return
+//		OK, INVALID_FORMAT if the file is not a log or SYS_ERROR.
+//
+static int wal_replay(map_t* self, const char* path) {
+	FILE* stream = fopen(path, "rb");
+	if (stream == NULL) return errno == ENOENT ? OK : SYS_ERROR;
+
+	// a log that has no complete header was never written to
+	unsigned char header[WAL_HEADER];
+	if (fread(header, WAL_HEADER, 1, stream) != 1) {
+		fclose(stream);
+		return truncate(path, 0) == 0 ? OK : SYS_ERROR;
+	}
+	if (map_load64(header) != WAL_MAGIC || map_load32(header + 8) != WAL_VERSION) {
+		fclose(stream);
+		return INVALID_FORMAT;
+	}
+
+	unsigned char* buffer = NULL;
+	size_t length = 0;
+	off_t valid = WAL_HEADER;
+	int result = OK;
+	for (;;) {
+		unsigned char record[WAL_RECORD];
+		if (fread(record, WAL_RECORD, 1, stream) != 1) break;
+
+		const int op = record[4];
+		const uint32_t keyLength = map_load32(record + 5);
+		const uint32_t valueLength = map_load32(record + 9);
+		const size_t stored = valueLength != WAL_NULL ? valueLength : 0;
+		if (keyLength > WAL_MAX_LENGTH || stored > WAL_MAX_LENGTH) break;
+
+		// the key and value are read behind each other, with room for both terminators
+		const size_t bytes = keyLength + stored;
+		if (length < bytes + 2) {
+			unsigned char* newBuffer = realloc(buffer, bytes + 2);
+			if (newBuffer == NULL) { result = SYS_ERROR; break; }
+			buffer = newBuffer;
+			length = bytes + 2;
+		}
+		if (bytes > 0 && fread(buffer, bytes, 1, stream) != 1) break;
+		if (map_crc32c(map_crc32c(0, record + 4, WAL_RECORD - 4), buffer, bytes) != map_load32(record)) break;
+		valid += WAL_RECORD + bytes;
+
+		if (op == WAL_PUT) {
+			// the map keeps the key and value, so they are copied to the memory owned by the map
+			char* key = map_alloc(self, bytes + 2);
+			if (key == NULL) { result = SYS_ERROR; break; }
+			memcpy(key, buffer, keyLength);
+			key[keyLength] = 0;
+			char* value = NULL;
+			if (valueLength != WAL_NULL) {
+				value = key + keyLength + 1;
+				memcpy(value, buffer + keyLength, stored);
+				value[stored] = 0;
+			}
+			if (map_put(self, key, value) == SYS_ERROR) { result = SYS_ERROR; break; }
+		} else if (op == WAL_REMOVE) {
+			buffer[keyLength] = 0;
+			map_remove(self, (const char*)buffer);
+		} else {
+			result = INVALID_FORMAT;
+			break;
+		}
+	}
+
+	free(buffer);
+	fclose(stream);
+	if (result != OK) return result;
+
+	// drop an incomplete record at the end, new records would not be readable after it
+	struct stat info;
+	if (stat(path, &info) != 0) return SYS_ERROR;
+	if (info.st_size > valid && truncate(path, valid) != 0) return SYS_ERROR;
+	return OK;
+}
+
+//
+//	Recovers the map after a crash: loads the snapshot and replays the log on top of it, including the old log of a
+//	compaction that did not finish. All files are optional.
+//	The map must be initialized and should be empty, a log attached to it is not written while recovering.
+//
+//	@param self
+//		the map to recover.
+//	@param snapshotPath
+//		the path of the snapshot written by map_serialize or NULL.
+//	@param logPath
+//		the path of the log file or NULL.
+//	@return
+//		OK, NULL_POINTER, NOT_INITIALIZED, INVALID_FORMAT or SYS_ERROR.
+//
+int map_recover(map_t* self, const char* snapshotPath, const char* logPath) {
+	if (self == NULL) return NULL_POINTER;
+	if (self->magic != MAGIC) return NOT_INITIALIZED;
+
+	map_wal_t* wal = self->wal;
+	self->wal = NULL;
+
+	int result = OK;
+	if (snapshotPath != NULL) {
+		FILE* stream = fopen(snapshotPath, "rb");
+		if (stream != NULL) {
+			result = map_deserialize(self, stream);
+			fclose(stream);
+		} else if (errno != ENOENT) {
+			result = SYS_ERROR;
+		}
+	}
+	if (result == OK && logPath != NULL) {
+		// the log of an unfinished compaction comes before the current log
+		char* frozen = wal_path(logPath, WAL_FROZEN_SUFFIX);
+		if (frozen == NULL) result = SYS_ERROR;
+		if (result == OK) result = wal_replay(self, frozen);
+		if (result == OK) result = wal_replay(self, logPath);
+		free(frozen);
+	}
+
+	self->wal = wal;
+	return result;
+}
+
+//
+//	The background thread of a compaction. Loads the snapshot and the old log into a private map, writes the new
+//	snapshot to a temporary file and replaces the snapshot with it. Afterwards the old log is not needed anymore.
+//
+//	@param argument
+//		the compaction.
+//	@return
+//		NULL.
+//
+static void* wal_compact(void* argument) {
+	map_compact_t* self = argument;
+	char* temporary = wal_path(self->snapshotPath, WAL_TEMPORARY_SUFFIX);
+	if (temporary == NULL) {
+		self->result = SYS_ERROR;
+		return NULL;
+	}
+
+	map_t map;
+	map_init(&map);
+	int result = map_recover(&map, self->snapshotPath, NULL);
+	if (result == OK) result = wal_replay(&map, self->frozenPath);
+
+	if (result == OK) {
+		FILE* stream = fopen(temporary, "wb");
+		if (stream == NULL) {
+			result = SYS_ERROR;
+		} else {
+			result = map_serialize(&map, stream);
+			if (result == OK && (fflush(stream) != 0 || fsync(fileno(stream)) != 0)) result = SYS_ERROR;
+			if (fclose(stream) != 0) result = SYS_ERROR;
+		}
+	}
+	map_destroy(&map);
+
+	// the new snapshot contains the old log, as soon as it replaced the old snapshot the old log can be deleted
+	if (result == OK && rename(temporary, self->snapshotPath) != 0) result = SYS_ERROR;
+	if (result == OK) result = wal_sync_directory(self->snapshotPath);
+	if (result == OK && unlink(self->frozenPath) != 0) result = SYS_ERROR;
+	if (result != OK) unlink(temporary);
+
+	free(temporary);
+	self->result = result;
+	return NULL;
+}
+
+//
+//	Starts a compaction: the log is rotated and a background thread merges the snapshot and the old log into a new
+//	snapshot. If the old log of a compaction interrupted by a crash still exists, the log is not rotated, but the old
+//	log merged. Only one compaction of a log runs at a time, the next one can start after map_compact_wait. The map
+//	must not be changed while this is called, but can be used normally while the compaction runs.
+//
+//	@param self
+//		the compaction to start.
+//	@param wal
+//		the log of the map.
+//	@param snapshotPath
+//		the path of the snapshot, it does not need to exist.
+//	@return
+//		OK, NULL_POINTER, IN_PROGRESS if a compaction of the log was not waited for yet or SYS_ERROR.
+//
+int map_compact_start(map_compact_t* self, map_wal_t* wal, const char* snapshotPath) {
+	if (self == NULL || wal == NULL || snapshotPath == NULL) return NULL_POINTER;
+
+	// a running compaction writes the same snapshot from the same old log
+	if (wal->compaction != NULL) return IN_PROGRESS;
+
+	// otherwise an old log is left over from a crash
+	const int rotated = map_wal_rotate(wal);
+	if (rotated != OK && rotated != IN_PROGRESS) return rotated;
+
+	self->result = IN_PROGRESS;
+	self->snapshotPath = wal_path(snapshotPath, "");
+	self->frozenPath = wal_path(wal->path, WAL_FROZEN_SUFFIX);
+	if (self->snapshotPath != NULL && self->frozenPath != NULL && pthread_create(&self->thread, NULL, wal_compact, self) == 0) {
+		self->wal = wal;
+		wal->compaction = self;
+		return OK;
+	}
+
+	free(self->snapshotPath);
+	free(self->frozenPath);
+	self->snapshotPath = NULL;
+	self->frozenPath = NULL;
+	return SYS_ERROR;
+}
+
+//
+//	Waits until the compaction finished and returns its result.
+//
+//	@param self
+//		the compaction started by map_compact_start.
+//	@return
+//		OK, INVALID_FORMAT if the snapshot or the old log was corrupted or SYS_ERROR.
+//
+int map_compact_wait(map_compact_t* self) {
+	if (self == NULL) return NULL_POINTER;
+	if (self->snapshotPath == NULL) return self->result;
+
+	pthread_join(self->thread, NULL);
+	if (self->wal->compaction == self) self->wal->compaction = NULL;
+	free(self->snapshotPath);
+	free(self->frozenPath);
+	self->snapshotPath = NULL;
+	self->frozenPath = NULL;
+	return self->result;
+}
@@ -0,0 +1,108 @@
+#ifndef __A1_WAL_H__
+#define __A1_WAL_H__
+
+#include <inttypes.h>
+#include <pthread.h>
+#include "map.h"
+
+//
+//	The write-ahead log records every successful map_put and map_remove of the map it is attached to, so that the
+//	map can be recovered after a crash from the latest snapshot plus the log. The operations are collected in a
+//	buffer and written as a group (group commit), the sync policy decides how durable a group is:
+//
+//	WAL_SYNC_NONE	the group is written, but the operating system decides when it reaches the disk.
+//	WAL_SYNC_COMMIT	every group is synced to the disk before the next operation is accepted.
+//
+//	A group is committed once it holds batch operations or when the first operation in it is older than delay
+//	milliseconds. Because nothing happens without a call into the log, map_wal_commit should be called when the
+//	application is idle. A batch of 1 with WAL_SYNC_COMMIT makes every operation durable before it returns.
+//
+//	The operations of a group are applied to the map when they are appended, before the group is committed. If
+//	the group cannot be written or synced, the file is cut back to the previous group, the group stays in the buffer
+//	and the log fails: every further append and commit returns SYS_ERROR, so the map is not changed anymore, until
+//	map_wal_reopen wrote the group. Then the log matches the map again.
+//
+//	To keep the log from growing without bound, map_compact_start renames the log to "<log>.old", starts a new log
+//	and merges the old snapshot with the old log into a new snapshot in a background thread, without touching the
+//	live map. The new snapshot replaces the old one atomically (rename) and then the old log is deleted. Recovery
+//	replays "<log>.old" before the log, if it still exists. Replaying a log again on a snapshot that already
+//	contains it has no effect, because every logged put only succeeded for an absent key and every logged remove
+//	only for a present key, so a crash at any point of the compaction is safe.
+//
+
+// the operations recorded in the log
+#define WAL_PUT 1
+#define WAL_REMOVE 2
+
+// the sync policies
+#define WAL_SYNC_NONE 0
+#define WAL_SYNC_COMMIT 1
+
+// identifies a log file, "KVAWAL" followed by the format version
+#define WAL_MAGIC 0x4B564157414C0000L
+#define WAL_VERSION 2
+
+// appended to the path of the log while it is compacted
+#define WAL_FROZEN_SUFFIX ".old"
+
+// appended to the path of the snapshot while a new one is written
+#define WAL_TEMPORARY_SUFFIX ".tmp"
+
+// the state of an open log
+typedef struct map_wal_s {
+	// the path and file descriptor of the log file
+	char* path;
+	int fd;
+
+	// the sync policy
+	int sync;
+
+	// the amount of operations and the time in nanoseconds after which a group is committed
+	unsigned int batch;
+	uint64_t delay;
+
+	// the operations not yet committed, encoded
+	unsigned char* buffer;
+	size_t used;
+	size_t length;
+
+	// the amount of operations in the buffer and the time the first of them was appended
+	unsigned int pending;
+	uint64_t since;
+
+	// the size of the log file up to the end of the last committed group
+	uint64_t committed;
+
+	// set when a group could not be committed, then the log refuses all operations until map_wal_reopen
+	int failed;
+
+	// the compaction of the log not yet waited for, NULL if there is none
+	struct map_compact_s* compaction;
+} map_wal_t;
+
+// the state of a compaction running in the background
+typedef struct map_compact_s {
+	pthread_t thread;
+
+	// the log being compacted
+	map_wal_t* wal;
+
+	// the paths of the snapshot and of the log being merged into it
+	char* snapshotPath;
+	char* frozenPath;
+
+	// the result of the compaction, valid after map_compact_wait
+	int result;
+} map_compact_t;
+
+int map_wal_open(map_wal_t*, const char*, int, unsigned int, unsigned int);
+int map_wal_append(map_wal_t*, int, const char*, const char*);
+int map_wal_commit(map_wal_t*);
+int map_wal_reopen(map_wal_t*);
+int map_wal_close(map_wal_t*);
+int map_wal_attach(map_t*, map_wal_t*);
+int map_wal_rotate(map_wal_t*);
+int map_recover(map_t*, const char*, const char*);
+int map_compact_start(map_compact_t*, map_wal_t*, const char*);
+int map_compact_wait(map_compact_t*);
+#endif